@@ -39,8 +39,7 @@ int main(int argc, char *argv[]) {
         writer.write_traj(ts, atoms);
         verlet_step1(atoms, timestep);
         double epot = lj_direct_summation(atoms, epsilon, sigma);
-        verlet_step2(atoms, timestep);
-        double ekin = atoms.kinetic_energy();
+        double ekin = verlet_step2(atoms, timestep);
         equilibrium.step(atoms, ts, atoms.current_temperature());
         writer.write_stats(ts, ekin, epot, atoms.current_temperature_kelvin());
     }
@@ -1,6 +1,7 @@
 #include "atoms.h"
 #include "lj_direct_summation.h"
 #include "neighbors.h"
+#include "potential.h"
 #include "thermostat.h"
 #include "simulation_utils.h"
 #include "types.h"
@@ -34,14 +35,16 @@ int main(int argc, char *argv[]) {
     Equilibrium equilibrium(sim.relaxation_factor(), sim.relaxation_time(),
                             sim.target_temperature(), sim.timestep(), sim.max_timesteps());
     NeighborList neighbor_list;
+    PotentialOptions potential_options{sim.precision()};
 
     // simulate
     for (size_t ts = 0; ts < sim.max_timesteps(); ts++) {
         writer.write_traj(ts, atoms);
+        // only evaluate the potential energy when it is written
+        potential_options.energy = ts % writer.get_output_interval() == 0;
         verlet_step1(atoms, timestep);
-        double epot = lj_direct_summation(atoms, neighbor_list, sim.cutoff(), epsilon, sigma);
-        verlet_step2(atoms, timestep);
-        double ekin = atoms.kinetic_energy();
+        double epot = lj_direct_summation(atoms, neighbor_list, sim.cutoff(), epsilon, sigma, potential_options);
+        double ekin = verlet_step2(atoms, timestep);
         equilibrium.step(atoms, ts, atoms.current_temperature());
         writer.write_stats(ts, ekin, epot, atoms.current_temperature_kelvin());
     }
@@ -1,70 +1,307 @@
 #include "atoms.h"
 #include "average.h"
 #include "ducastelle.h"
+#include "minimizer.h"
 #include "neighbors.h"
+#include "omp_support.h"
+#include "potential.h"
+#include "simulation.h"
 #include "simulation_utils.h"
 #include "thermostat.h"
+#include "thread_pool.h"
+#include "timestep_controller.h"
 #include "types.h"
 #include "verlet.h"
 #include "writer.h"
+#include <algorithm>
 #include <argparse/argparse.hpp>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <thread>
 
 namespace fs = std::filesystem;
 
+// One independent cluster together with its thermostat, energy pump and
+// output. Several clusters are simulated side by side on a thread pool.
+struct Cluster {
+    Atoms atoms;
+    Writer writer;
+    NeighborList neighbor_list;
+    PotentialOptions potential_options;
+    Equilibrium equilibrium;
+    EnergyPump pump;
+    double smoothing;
+    ExponentialAverage avg_temp;
+    // embedding forces of the multiple timestep integrator
+    Forces_t slow_forces;
+    std::optional<TimestepController> controller;
+    // energy deposited by the pump at the last drift measurement
+    double deposited = 0;
+    std::optional<FireParameters> fire;
+    // steps of the initial relaxation and of the actual simulation
+    Simulation relaxation;
+    Simulation simulation;
+
+    Cluster(Names_t &names, Positions_t &positions, const SimulationParameters &sim,
+            argparse::ArgumentParser &parser, const fs::path &pwd, const std::string &name)
+        : atoms(names, positions),
+          writer(pwd, parser, name),
+          neighbor_list(sim.cutoff(), sim.skin()),
+          potential_options{sim.precision()},
+          equilibrium(sim.relaxation_factor(), sim.relaxation_time(), sim.target_temperature(), sim.timestep(),
+                      sim.init_timesteps()),
+          pump(sim.relaxation_time_deposit(), sim.delta_Q()),
+          smoothing(parser.get<double>("--smoothing")),
+          avg_temp(smoothing),
+          relaxation(sim.timestep(), 0),
+          simulation(sim.timestep(), writer.get_output_interval()) {
+        atoms.set_mass(parser.get<double>("--mass") * 103.6);
+        if (parser.get<bool>("--adaptive_timestep")) {
+            auto limits = parser.get<std::vector<double>>("--timestep_limits");
+            // with a skin, atoms should not cross it within a few steps
+            double max_displacement = parser.get<double>("--max_displacement");
+            if (sim.skin() > 0) {
+                max_displacement = std::min(max_displacement, sim.skin() / 4);
+            }
+            controller.emplace(sim.timestep(), limits[0], limits[1], max_displacement,
+                               parser.get<double>("--max_drift"));
+        }
+        if (parser.get<bool>("--minimize")) {
+            fire.emplace();
+            fire->fmax = parser.get<double>("--fmax");
+            fire->timestep = sim.timestep();
+            fire->max_timestep = 10 * sim.timestep();
+        }
+
+        add_integrator_stages(relaxation, sim);
+        add_thermostat_stage(sim);
+
+        simulation.add("trajectory", [this](Step &step) { writer.write_traj(step.ts, atoms); },
+                       Schedule{writer.get_output_interval()});
+        add_integrator_stages(simulation, sim);
+        add_output_stages();
+    }
+
+    // the integrator, energies are only evaluated on output steps
+    void add_integrator_stages(Simulation &pipeline, const SimulationParameters &sim) {
+        if (sim.respa_steps() > 1) {
+            pipeline.add("respa", [this, &sim](Step &step) { respa(sim, step); });
+        } else {
+            add_verlet_stages(pipeline, atoms, neighbor_list, potential_options, sim.cutoff());
+        }
+    }
+
+    // the thermostat of the initial relaxation: Berendsen is folded into the
+    // integrator with the kinetic energy of the previous step, Bussi scales
+    // the velocities after the integrator with the kinetic energy of the
+    // current step, as in the MPI drivers
+    void add_thermostat_stage(const SimulationParameters &sim) {
+        std::string integrator = relaxation.contains("respa") ? "respa" : "verlet2";
+        switch (sim.thermostat()) {
+        case ThermostatType::Berendsen:
+            relaxation.insert_before(integrator, "thermostat", [this](Step &step) {
+                step.velocity_scale = equilibrium.scale(step.ts, atoms.temperature(step.ekin));
+            });
+            break;
+        case ThermostatType::Bussi: {
+            BussiThermostat thermostat(sim.target_temperature(), sim.relaxation_time(), sim.seed());
+            relaxation.insert_after(integrator, "thermostat", [this, &sim, thermostat](Step &step) {
+                if (equilibrium.active(step.ts)) {
+                    double scale = thermostat.scale(step.ekin, atoms.nb_atoms(),
+                                                    sim.respa_steps() * step.timestep, step.ts);
+                    atoms.velocities *= scale;
+                    step.ekin *= scale * scale;
+                }
+            });
+            break;
+        }
+        case ThermostatType::Langevin: {
+            LangevinThermostat thermostat(sim.target_temperature(), sim.relaxation_time(), sim.seed());
+            if (integrator == "respa") {
+                relaxation.insert_after(integrator, "thermostat", [this, &sim, thermostat](Step &step) {
+                    if (equilibrium.active(step.ts)) {
+                        thermostat.step(atoms, sim.respa_steps() * step.timestep, step.ts, atoms.nb_atoms());
+                    }
+                });
+            } else {
+                relaxation.replace(integrator, [this, thermostat](Step &step) {
+                    step.ekin = equilibrium.active(step.ts)
+                                    ? verlet_step2(atoms, step.timestep, thermostat, step.ts, atoms.nb_atoms())
+                                    : verlet_step2(atoms, step.timestep, 1, atoms.nb_atoms());
+                });
+            }
+            break;
+        }
+        }
+    }
+
+    // statistics, timestep control and the energy pump of the actual
+    // simulation
+    void add_output_stages() {
+        simulation.add("stats", [this](Step &step) { writer.write_stats(step.ts, step.ekin, step.epot, avg_temp.get()); },
+                       Schedule{writer.get_output_interval()});
+        if (controller) {
+            simulation.add("timestep", [this](Step &step) {
+                bool changed = controller->update(atoms, step.displacement);
+                if (step.output) {
+                    changed |= controller->update_drift(step.ekin + step.epot, pump.total_Q() - deposited,
+                                                        atoms.nb_atoms());
+                    deposited = pump.total_Q();
+                }
+                if (changed) {
+                    simulation.set_timestep(controller->timestep());
+                    writer.log("timestep " + std::to_string(step.ts) + ": " + controller->reason() +
+                                   " limit, new timestep ",
+                               controller->timestep());
+                }
+            });
+        }
+        simulation.add("pump", [this](Step &step) {
+            if (pump.relaxed()) {
+                avg_temp.update(atoms.temperature(step.ekin) * 1e5);
+            }
+            pump.step(atoms, step.ts, step.ekin);
+        });
+    }
+
+    // advance by `respa_steps` timesteps, integrating the repulsion with the
+    // timestep and evaluating the embedding forces only once
+    void respa(const SimulationParameters &sim, Step &step) {
+        PotentialOptions fast_options{potential_options}, slow_options{potential_options};
+        fast_options.energy = slow_options.energy = step.output;
+        fast_options.terms = ForceTerms::Repulsive;
+        slow_options.terms = ForceTerms::Embedding;
+        double epot_fast = 0, epot_slow = 0;
+        auto fast_forces = [&](double max_displacement) {
+            if (neighbor_list.is_stale(max_displacement)) {
+                neighbor_list.update(atoms);
+            }
+            epot_fast = ducastelle(atoms, neighbor_list, atoms.nb_atoms(), fast_options, sim.cutoff());
+        };
+        auto compute_slow_forces = [&]() {
+            epot_slow = ducastelle(atoms, neighbor_list, atoms.nb_atoms(), slow_options, sim.cutoff());
+        };
+
+        // forces at the initial positions
+        if (slow_forces.cols() != atoms.positions.cols()) {
+            neighbor_list.update(atoms);
+            slow_forces.resize(3, atoms.positions.cols());
+            atoms.forces.swap(slow_forces);
+            compute_slow_forces();
+            atoms.forces.swap(slow_forces);
+            fast_forces(0);
+        }
+
+        step.displacement =
+            respa_step(atoms, slow_forces, step.timestep, sim.respa_steps(), fast_forces, compute_slow_forces);
+        atoms.velocities *= step.velocity_scale;
+        step.epot = epot_fast + epot_slow;
+        step.ekin = atoms.kinetic_energy();
+    }
+
+    // relax the geometry into the nearest minimum
+    void minimize(const SimulationParameters &sim) {
+        auto compute_forces = [&](double max_displacement) {
+            if (neighbor_list.is_stale(max_displacement)) {
+                neighbor_list.update(atoms);
+            }
+            ducastelle(atoms, neighbor_list, atoms.nb_atoms(), potential_options, sim.cutoff());
+            return int(atoms.nb_atoms());
+        };
+        potential_options.energy = false;
+        auto result = fire_minimize(atoms, compute_forces, *fire);
+        writer.log((result.converged ? "minimized in " : "minimizer did not converge in ") +
+                       std::to_string(result.nb_steps) + " steps, largest force: ",
+                   result.fmax);
+
+        // the thermostat cannot heat atoms at rest, start from random
+        // velocities without net momentum at twice the target temperature;
+        // about half of the kinetic energy flows into the potential energy.
+        // The velocities are keyed on the ids and the seed, such that
+        // clusters minimized side by side do not share a random state.
+        random_velocities(atoms, 2 * sim.target_temperature(), sim.seed(), atoms.nb_atoms());
+        atoms.velocities.colwise() -= atoms.velocities.rowwise().mean();
+        atoms.velocities *= std::sqrt(2 * sim.target_temperature() / atoms.current_temperature());
+    }
+
+    // relax, energies are not needed here
+    void relax(const SimulationParameters &sim) {
+        if (fire) {
+            minimize(sim);
+        }
+        relaxation.run(0, sim.init_timesteps());
+        avg_temp = ExponentialAverage(smoothing, atoms.current_temperature_kelvin());
+    }
+
+    // simulate the timesteps [begin, end)
+    void simulate(size_t begin, size_t end) { simulation.run(begin, end); }
+};
 
 int main(int argc, char *argv[]) {
     argparse::ArgumentParser parser = default_parser("milestone 07", argc, argv);
 
     fs::path filepath = argv[0];
     auto pwd = filepath.parent_path();
-    Writer writer(pwd, parser);
+    // the clusters write the csv and xyz files, this one only the console
+    Writer writer(parser);
 
-    auto input_path = parser.get<std::string>("--input");
-    auto [names, positions]{read_xyz(input_path)};
+    SimulationParameters sim(parser);
 
-    writer.log("loaded file from: ", input_path);
+    // a single input keeps the output file names of a plain run
+    std::vector<std::string> input_paths;
+    if (parser.is_used("--inputs")) {
+        input_paths = parser.get<std::vector<std::string>>("--inputs");
+    } else {
+        input_paths.push_back(parser.get<std::string>("--input"));
+    }
+    bool batched = input_paths.size() > 1;
 
-    // initialize simulation
-    Atoms atoms(names, positions);
-    atoms.set_mass(parser.get<double>("--mass") * 103.6);
+    std::vector<std::unique_ptr<Cluster>> clusters;
+    for (const auto &input_path : input_paths) {
+        auto [names, positions]{read_xyz(input_path)};
+        writer.log("loaded file from: ", input_path);
+        std::string name = batched ? fs::path(input_path).stem().string() : "";
+        clusters.push_back(std::make_unique<Cluster>(names, positions, sim, parser, pwd, name));
+    }
 
-    SimulationParameters sim(parser);
-    ThermostatScheduler scheduler(sim.relaxation_factor(), sim.relaxation_time());
-    Equilibrium equilibrium(sim.relaxation_factor(), sim.relaxation_time(),
-                            sim.target_temperature(), sim.timestep(), sim.init_timesteps());
-    EnergyPump pump(sim.relaxation_time_deposit(), sim.delta_Q());
-    NeighborList neighbor_list(sim.cutoff());
+    // largest clusters first, such that small ones fill up the threads at the
+    // end of each chunk
+    std::stable_sort(clusters.begin(), clusters.end(),
+                     [](const auto &a, const auto &b) { return a->atoms.nb_atoms() > b->atoms.nb_atoms(); });
 
-    // relax
-    writer.log("Equilibriating the system...");
-    for (size_t i = 0; i < sim.init_timesteps(); i++) {
-        // writer.write_traj(i, atoms);
-        verlet_step1(atoms, sim.timestep());
-        neighbor_list.update(atoms);
-        double epot = ducastelle(atoms, neighbor_list, sim.cutoff());
-        verlet_step2(atoms, sim.timestep());
-        equilibrium.step(atoms, i, atoms.current_temperature());
+    size_t nb_threads = parser.get<size_t>("--threads");
+    if (nb_threads == 0) {
+        nb_threads = std::max(1u, std::thread::hardware_concurrency());
     }
+    ThreadPool pool(std::min(nb_threads, clusters.size()));
+    writer.log("number of threads: ", pool.size());
+    // threads left over by the pool share the loops of each cluster
+    int cluster_threads = std::max<size_t>(1, nb_threads / pool.size());
 
-    // simulate
-    bool relaxed = false;
-    double alpha = parser.get<double>("--smoothing");
-    ExponentialAverage avg_temp(alpha, atoms.current_temperature_kelvin());
+    writer.log("Equilibriating the system...");
+    pool.parallel_for(clusters.size(), [&](size_t i) {
+        OMP::set_threads(cluster_threads);
+        clusters[i]->relax(sim);
+    });
+
+    // simulate all clusters in lockstep, one output interval at a time
     writer.log("Starting simulation");
-    for (size_t ts = 0; ts < sim.max_timesteps(); ts++) {
-        writer.write_traj(ts, atoms);
-        verlet_step1(atoms, sim.timestep());
-        neighbor_list.update(atoms);
-        double epot = ducastelle(atoms, neighbor_list, sim.cutoff());
-        verlet_step2(atoms, sim.timestep());
-        double ekin = atoms.kinetic_energy();
-        writer.write_stats(ts, ekin, epot, avg_temp.get());
-        if (pump.relaxed()) {
-            avg_temp.update(atoms.current_temperature_kelvin());
+    size_t chunk = std::max<size_t>(1, writer.get_output_interval());
+    for (size_t begin = 0; begin < sim.max_timesteps(); begin += chunk) {
+        size_t end = std::min(begin + chunk, sim.max_timesteps());
+        pool.parallel_for(clusters.size(), [&](size_t i) {
+            OMP::set_threads(cluster_threads);
+            clusters[i]->simulate(begin, end);
+        });
+    }
+
+    for (const auto &cluster : clusters) {
+        for (const auto &timing : cluster->simulation.timings()) {
+            cluster->writer.log("time in " + timing.name + " [s]: ", timing.seconds);
         }
-        pump.step(atoms, ts, ekin);
+        cluster->writer.log("peak arena usage [bytes]: ", cluster->simulation.arena_peak());
     }
 
     return 0;
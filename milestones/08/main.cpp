@@ -2,10 +2,14 @@
 #include "average.h"
 #include "domain.h"
 #include "ducastelle.h"
+#include "minimizer.h"
 #include "mpi_support.h"
 #include "neighbors.h"
+#include "potential.h"
+#include "simulation_mpi.h"
 #include "simulation_utils.h"
 #include "simulation_utils_mpi.h"
+#include "thermo_mpi.h"
 #include "thermostat.h"
 #include "types.h"
 #include "verlet.h"
@@ -25,17 +29,19 @@ int main(int argc, char *argv[]) {
     MPIWriter writer(pwd, parser);
 
     auto input_path = parser.get<std::string>("--input");
-    auto [names, positions]{read_xyz(input_path)};
+    // every process reads a part of the atoms
+    Atoms atoms{read_xyz_all(input_path, MPI_COMM_WORLD)};
 
     writer.log("loaded file from: ", input_path);
+    writer.log("threads per process: ", init_threads(parser, MPI_COMM_WORLD));
 
     // initialize simulation
-    Atoms atoms(names, positions);
     atoms.set_mass(parser.get<double>("--mass") * 103.6);
     writer.debug("initialized atoms");
 
     SimulationParameters sim(parser);
-    NeighborList neighbor_list(sim.cutoff());
+    NeighborList neighbor_list(sim.cutoff(), sim.skin());
+    PotentialOptions potential_options{sim.precision()};
     writer.debug("initialized neighbors");
 
     Equilibrium equilibrium(sim.relaxation_factor(), sim.relaxation_time(),
@@ -43,59 +49,57 @@ int main(int argc, char *argv[]) {
     EnergyPump pump(sim.relaxation_time_deposit(), sim.delta_Q());
 
     // domain setup
-    auto domain = init_domain(atoms, parser);
+    auto domain = init_domain(atoms, parser, writer);
     writer.debug("initialized domain");
-    domain.enable(atoms);
+    domain.distribute(atoms);
     writer.debug("enabled domain");
+    int nb_atoms = MPI::allreduce(domain.nb_local(), MPI_SUM, MPI_COMM_WORLD);
+    ThermoReduction thermo(MPI_COMM_WORLD);
 
-    // relax
+    // relax, energies are not needed here
+    potential_options.energy = false;
     writer.log("Equilibriating the system...");
-    for (size_t i = 0; i < sim.init_timesteps(); i++) {
-        // writer.write_traj(i, atoms);
-        verlet_step1(atoms, sim.timestep());
-        domain.exchange_atoms(atoms);
-        domain.update_ghosts(atoms, 2 * sim.cutoff());
-        neighbor_list.update(atoms);
-        double epot = ducastelle(atoms, neighbor_list, sim.cutoff());
-        verlet_step2(atoms, sim.timestep());
-        double temp_local = atoms.current_temperature(domain.nb_local());
-        double temp = MPI::allreduce(temp_local, MPI_SUM, MPI_COMM_WORLD) / domain.size();
-        equilibrium.step(atoms, i, temp);
+    if (parser.get<bool>("--minimize")) {
+        auto result = minimize_domain(atoms, domain, neighbor_list, potential_options, sim,
+                                      parser.get<double>("--fmax"));
+        writer.log((result.converged ? "minimized in " : "minimizer did not converge in ") +
+                       std::to_string(result.nb_steps) + " steps, largest force: ",
+                   result.fmax);
     }
+    Simulation relaxation(sim.timestep(), 0);
+    add_domain_stages(relaxation, atoms, domain, thermo, neighbor_list, potential_options, sim.cutoff());
+    add_thermostat_stage(relaxation, atoms, domain, equilibrium, sim);
+    relaxation.run(0, sim.init_timesteps());
 
     // simulate
-    double current_temp_local = atoms.current_temperature_kelvin(domain.nb_local());
-    double current_temp = MPI::allreduce(current_temp_local, MPI_SUM, MPI_COMM_WORLD) / domain.size();
+    double ekin = MPI::allreduce(atoms.kinetic_energy(domain.nb_local()), MPI_SUM, MPI_COMM_WORLD);
+    double current_temp = atoms.temperature(ekin, nb_atoms) * 1e5;
     double alpha = parser.get<double>("--smoothing");
     ExponentialAverage avg_temp(alpha, current_temp);
-    writer.log("Starting actual simulation");
-    for (size_t ts = 0; ts < sim.max_timesteps(); ts++) {
-        verlet_step1(atoms, sim.timestep());
-        domain.exchange_atoms(atoms);
-        domain.update_ghosts(atoms, 2 * sim.cutoff());
-        neighbor_list.update(atoms);
-        double epot_local = ducastelle(atoms, neighbor_list, domain.nb_local(), sim.cutoff());
-        verlet_step2(atoms, sim.timestep());
-
-        double ekin_local = atoms.kinetic_energy(domain.nb_local());
-        double temp_local = atoms.current_temperature_kelvin(domain.nb_local());
-        double temp = MPI::allreduce(temp_local, MPI_SUM, MPI_COMM_WORLD) / domain.size();
-
-        double ekin = MPI::allreduce(ekin_local, MPI_SUM, MPI_COMM_WORLD);
-        double epot = MPI::allreduce(epot_local, MPI_SUM, MPI_COMM_WORLD);
-
+    Simulation simulation(sim.timestep(), writer.get_output_interval());
+    add_domain_stages(simulation, atoms, domain, thermo, neighbor_list, potential_options, sim.cutoff());
+    // Nothing overlaps with the reduction here: the pump scales the
+    // velocities with the kinetic energy of this step and the output reports
+    // it, so "reduced" directly follows "reduce". Deferring it to the next
+    // step would deposit energy with a stale kinetic energy.
+    simulation.insert_after("reduced", "temperature", [&](Step &step) {
         if (pump.relaxed()) {
-            avg_temp.update(temp);
+            avg_temp.update(atoms.temperature(step.ekin, nb_atoms) * 1e5);
         }
-        pump.step(atoms, ts, ekin);
+    });
+    simulation.add("pump", [&](Step &step) { pump.step(atoms, step.ts, step.ekin); });
+    simulation.add("output", [&](Step &step) {
+        writer.write_traj(step.ts, atoms, domain.nb_local());
+        writer.write_stats(step.ts, step.ekin, step.epot, avg_temp.get());
+    }, Schedule{writer.get_output_interval()});
 
-        if (ts % writer.get_output_interval() == 0) {
-            domain.disable(atoms);
-            writer.write_traj(ts, atoms);
-            writer.write_stats(ts, ekin, epot, avg_temp.get());
-            domain.enable(atoms);
-        }
+    writer.log("Starting actual simulation");
+    simulation.run(0, sim.max_timesteps());
+    writer.write_checkpoint(atoms, domain.nb_local());
+    for (const auto &timing : simulation.timings()) {
+        writer.log("time in " + timing.name + " [s]: ", timing.seconds);
     }
+    writer.log("peak arena usage [bytes]: ", simulation.arena_peak());
 
     return 0;
 }
@@ -0,0 +1,94 @@
+#ifndef __ALIGNED_ALLOCATOR_H
+#define __ALIGNED_ALLOCATOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+// Alignment of the per-atom arrays in bytes, a multiple of the cache line
+#ifndef ATOMS_ALIGNMENT
+#define ATOMS_ALIGNMENT 64
+#endif
+static_assert(ATOMS_ALIGNMENT % 64 == 0 && (ATOMS_ALIGNMENT & (ATOMS_ALIGNMENT - 1)) == 0,
+              "ATOMS_ALIGNMENT must be a power of two and a multiple of 64");
+
+// Allocator that aligns the data to `Alignment` bytes, e.g. to a cache line
+// such that SIMD loads over an array never straddle two lines. With
+// `HugePages`, arrays of at least one huge page are aligned to huge pages and
+// the kernel is asked to back them with transparent huge pages, which saves
+// TLB misses on large arrays that are swept every step.
+//
+// Elements are default-initialized, i.e. plain numbers are left untouched.
+// The pages of a new array are then only mapped where they are first written,
+// see first_touch.
+template <typename T, size_t Alignment, bool HugePages = false> struct AlignedAllocator {
+    using value_type = T;
+    template <typename U> struct rebind {
+        using other = AlignedAllocator<U, Alignment, HugePages>;
+    };
+
+    static constexpr size_t huge_page_size = 2 << 20;
+
+    AlignedAllocator() = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, Alignment, HugePages> &) {}
+
+    T *allocate(size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (HugePages && bytes >= huge_page_size) {
+            bytes = (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+            void *data = ::operator new(bytes, std::align_val_t(std::max(Alignment, huge_page_size)));
+#if defined(MADV_HUGEPAGE)
+            madvise(data, bytes, MADV_HUGEPAGE);
+#endif
+            return static_cast<T *>(data);
+        }
+        return static_cast<T *>(::operator new(bytes, std::align_val_t(Alignment)));
+    }
+    void deallocate(T *p, size_t n) {
+        if (HugePages && n * sizeof(T) >= huge_page_size) {
+            ::operator delete(p, std::align_val_t(std::max(Alignment, huge_page_size)));
+        } else {
+            ::operator delete(p, std::align_val_t(Alignment));
+        }
+    }
+
+    template <typename U> void construct(U *p) { ::new (static_cast<void *>(p)) U; }
+    template <typename U, typename... Args> void construct(U *p, Args &&...args) {
+        ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+    }
+
+    template <typename U> bool operator==(const AlignedAllocator<U, Alignment, HugePages> &) const { return true; }
+    template <typename U> bool operator!=(const AlignedAllocator<U, Alignment, HugePages> &) const { return false; }
+};
+
+// vector with cache line aligned data
+template <typename T> using AlignedVector = std::vector<T, AlignedAllocator<T, 64>>;
+
+// Storage of the large arrays that every step sweeps, i.e. the per-atom arrays
+// and the neighbor list. Alignment and huge pages are chosen at configure time
+// (ATOMS_ALIGNMENT and USE_HUGE_PAGES).
+#ifdef USE_HUGE_PAGES
+template <typename T> using PerAtomVector = std::vector<T, AlignedAllocator<T, ATOMS_ALIGNMENT, true>>;
+#else
+template <typename T> using PerAtomVector = std::vector<T, AlignedAllocator<T, ATOMS_ALIGNMENT>>;
+#endif
+
+// Write zeros to the entries [begin, end) of a freshly allocated array. On a
+// NUMA machine a page is placed on the memory of the socket that writes it
+// first, so the array is zeroed with the same static partition of the atoms
+// over the threads as the loops of the kernels.
+template <typename T> void first_touch(T *data, ptrdiff_t begin, ptrdiff_t end) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (ptrdiff_t i = begin; i < end; i++) {
+        data[i] = T{};
+    }
+}
+
+#endif // __ALIGNED_ALLOCATOR_H
@@ -0,0 +1,106 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include "aligned_allocator.h"
+#include <Eigen/Dense>
+#include <algorithm>
+#include <vector>
+
+// Bump allocator for temporaries that live at most one step, e.g. the scratch
+// arrays of the potentials and the send and receive buffers of the domain
+// decomposition. Memory is handed out by advancing an offset and released all
+// at once when the outermost Scope closes. If a step needs more than the
+// arena holds, further blocks are chained; on release they are merged into a
+// single block that holds the peak, so once the arena has seen the largest
+// step it no longer touches the heap.
+class Arena {
+  public:
+    // alignment of every allocation, a cache line
+    static constexpr size_t alignment = 64;
+
+    // Releases everything allocated after the outermost scope was opened once
+    // that scope closes. Nested scopes, e.g. of a kernel within a simulation
+    // step, keep their memory until the outermost one closes.
+    class Scope {
+        Arena &arena_;
+
+      public:
+        explicit Scope(Arena &arena) : arena_(arena) { arena_.depth_++; }
+        ~Scope() {
+            if (--arena_.depth_ == 0) {
+                arena_.reset();
+            }
+        }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+
+  private:
+    std::vector<AlignedVector<unsigned char>> blocks_;
+    // offset into the last block
+    size_t offset_ = 0;
+    // bytes handed out since the last reset, and the most ever
+    size_t used_ = 0, peak_ = 0;
+    int depth_ = 0;
+
+  public:
+    explicit Arena(size_t capacity = 0) {
+        if (capacity > 0) {
+            blocks_.emplace_back(capacity);
+        }
+    }
+
+    // `bytes` of uninitialized memory, never a null pointer
+    void *allocate(size_t bytes) {
+        bytes = std::max<size_t>(1, (bytes + alignment - 1) / alignment) * alignment;
+        if (blocks_.empty() || offset_ + bytes > blocks_.back().size()) {
+            blocks_.emplace_back(std::max(bytes, capacity()));
+            offset_ = 0;
+        }
+        void *data = blocks_.back().data() + offset_;
+        offset_ += bytes;
+        used_ += bytes;
+        peak_ = std::max(peak_, used_);
+        return data;
+    }
+
+    // uninitialized array of plain scalars, e.g. map<Eigen::Array3Xd>(3, n)
+    template <typename T> Eigen::Map<T, Eigen::Aligned64> map(Eigen::Index rows, Eigen::Index cols) {
+        using Scalar = typename T::Scalar;
+        return {static_cast<Scalar *>(allocate(rows * cols * sizeof(Scalar))), rows, cols};
+    }
+    template <typename T> Eigen::Map<T, Eigen::Aligned64> map(Eigen::Index size) {
+        using Scalar = typename T::Scalar;
+        return {static_cast<Scalar *>(allocate(size * sizeof(Scalar))), size};
+    }
+
+    // release all allocations
+    void reset() {
+        if (blocks_.size() > 1) {
+            blocks_.clear();
+            blocks_.emplace_back(peak_);
+        }
+        offset_ = 0;
+        used_ = 0;
+    }
+
+    // bytes currently handed out, the most handed out between two resets and
+    // the bytes held
+    size_t used() const { return used_; }
+    size_t peak() const { return peak_; }
+    size_t capacity() const {
+        size_t capacity = 0;
+        for (const auto &block : blocks_) {
+            capacity += block.size();
+        }
+        return capacity;
+    }
+};
+
+// arena of the calling thread, every thread steps its own simulations
+inline Arena &step_arena() {
+    thread_local Arena arena;
+    return arena;
+}
+
+#endif // __ARENA_H
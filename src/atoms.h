@@ -2,95 +2,242 @@
 #define __ATOMS_H
 
 #include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <new>
+#include <numeric>
+#include <string>
+#include <utility>
+#include "aligned_allocator.h"
 #include "types.h"
 
-// Holds the current state of a simulation.
+// Names of atoms by their ids, stored as runs of consecutive ids that share a
+// name. Inputs usually list the atoms of an element together, so this holds a
+// few strings rather than one per atom, and every process can keep the names
+// of all atoms even when it holds only a part of them.
+class NameRuns {
+  private:
+    // first id of every run and its name
+    std::vector<int64_t> first_;
+    std::vector<std::string> names_;
+
+  public:
+    NameRuns() = default;
+    NameRuns(size_t nb_atoms, const std::string &name) {
+        if (nb_atoms > 0) {
+            append(0, name);
+        }
+    }
+    NameRuns(const Names_t &names) {
+        for (size_t i = 0; i < names.size(); i++) {
+            append(i, names[i]);
+        }
+    }
+
+    // name atoms from `id` on, ids have to be appended in increasing order
+    void append(int64_t id, const std::string &name) {
+        assert(first_.empty() || id > first_.back());
+        if (names_.empty() || names_.back() != name) {
+            first_.push_back(id);
+            names_.push_back(name);
+        }
+    }
+
+    const std::string &operator[](int64_t id) const {
+        assert(!first_.empty() && id >= first_.front());
+        return names_[std::upper_bound(first_.begin(), first_.end(), id) - first_.begin() - 1];
+    }
+
+    // the runs, e.g. to communicate them
+    size_t nb_runs() const { return first_.size(); }
+    int64_t first(size_t run) const { return first_[run]; }
+    const std::string &name(size_t run) const { return names_[run]; }
+};
+
+// Holds the current state of a simulation. The per-atom arrays reserve
+// capacity beyond the current number of atoms, such that e.g. ghost atoms can
+// be added and removed every step without reallocating or copying; the public
+// members are views of the atoms in use. The memory layout of the vectors is
+// chosen at compile time, see Vectors_t.
 class Atoms {
   private:
     double mass_ = 1.0;
-  public:
-    Positions_t positions;
-    Velocities_t velocities;
-    Forces_t forces;
-    Masses_t masses;
-    Names_t names;
-
-    Atoms(const size_t nb_atoms)
-        : positions(3, nb_atoms),
-          velocities(3, nb_atoms),
-          forces(3, nb_atoms),
-          masses(nb_atoms),
-          names(nb_atoms) {
-        positions.setZero();
-        velocities.setZero();
-        forces.setZero();
-        masses.setOnes();
-        std::fill(names.begin(), names.end(), "H");
+    size_t nb_atoms_ = 0;
+    struct Storage {
+#ifdef USE_SOA
+        // x, y and z of all atoms one after the other, each padded to
+        // `stride` entries such that every coordinate starts on an aligned
+        // boundary
+        size_t stride = 0;
+#endif
+        PerAtomVector<double> positions, velocities, forces;
+        PerAtomVector<double> masses;
+        PerAtomVector<int64_t> ids;
+    } storage_;
+
+    // reallocate `vector` with `size` entries, keeping the first `nb_kept`
+    template <typename T> static void grow(PerAtomVector<T> &vector, size_t size, size_t nb_kept) {
+        PerAtomVector<T> grown(size);
+        first_touch(grown.data(), 0, size);
+        std::copy_n(vector.begin(), nb_kept, grown.begin());
+        vector.swap(grown);
     }
 
-    Atoms(const Positions_t &p)
-        : positions{p},
-          velocities{3, p.cols()},
-          forces{3, p.cols()},
-          masses{p.cols()},
-          names(p.cols()) {
-        velocities.setZero();
-        forces.setZero();
-        masses.setOnes();
-        std::fill(names.begin(), names.end(), "H");
+    // point the views to the first nb_atoms_ entries of the storage
+    void bind() {
+#ifdef USE_SOA
+        Eigen::Stride<1, Eigen::Dynamic> stride(1, storage_.stride);
+        new (&positions) Vectors_t(storage_.positions.data(), 3, nb_atoms_, stride);
+        new (&velocities) Vectors_t(storage_.velocities.data(), 3, nb_atoms_, stride);
+        new (&forces) Vectors_t(storage_.forces.data(), 3, nb_atoms_, stride);
+#else
+        new (&positions) Vectors_t(storage_.positions.data(), 3, nb_atoms_);
+        new (&velocities) Vectors_t(storage_.velocities.data(), 3, nb_atoms_);
+        new (&forces) Vectors_t(storage_.forces.data(), 3, nb_atoms_);
+#endif
+        new (&masses) Eigen::Map<Masses_t>(storage_.masses.data(), nb_atoms_);
+        new (&ids) Eigen::Map<Ids_t>(storage_.ids.data(), nb_atoms_);
     }
 
-    Atoms(const Names_t &n, Positions_t &p)
-        : positions{p},
-          velocities{3, p.cols()},
-          forces{3, p.cols()},
-          masses{p.cols()},
-          names{n} {
+    // allocate `nb_atoms` atoms at rest with unit mass and consecutive ids
+    void allocate(size_t nb_atoms) {
+        reserve(nb_atoms);
+        nb_atoms_ = nb_atoms;
+        bind();
         velocities.setZero();
         forces.setZero();
         masses.setOnes();
+        ids = Ids_t::LinSpaced(nb_atoms, 0, nb_atoms - 1);
+    }
+
+  public:
+    Vectors_t positions{nullptr, 3, 0};
+    Vectors_t velocities{nullptr, 3, 0};
+    Vectors_t forces{nullptr, 3, 0};
+    Eigen::Map<Masses_t> masses{nullptr, 0};
+    // names of all atoms by their ids, they do not follow the
+    // atoms across domains, see name()
+    NameRuns names;
+    // stable global ids that follow the atoms across domains, e.g. to key
+    // random numbers or to write atoms in their initial order; ghost atoms
+    // carry the ids of the atoms they are images of
+    Eigen::Map<Ids_t> ids{nullptr, 0};
+
+    Atoms(const size_t nb_atoms) : names(nb_atoms, "H") {
+        allocate(nb_atoms);
+        positions.setZero();
+    }
+
+    Atoms(const Positions_t &p) : names(p.cols(), "H") {
+        allocate(p.cols());
+        positions = p;
+    }
+
+    Atoms(const Names_t &n, Positions_t &p) : names{n} {
+        allocate(p.cols());
+        positions = p;
     }
 
-    Atoms(const Positions_t &p, const Velocities_t &v)
-        : positions{p},
-          velocities{v},
-          forces{3, p.cols()},
-          masses{p.cols()},
-          names(p.cols()) {
+    Atoms(const Positions_t &p, const Velocities_t &v) : names(p.cols(), "H") {
         assert(p.cols() == v.cols());
-        forces.setZero();
-        masses.setOnes();
-        std::fill(names.begin(), names.end(), "H");
+        allocate(p.cols());
+        positions = p;
+        velocities = v;
     }
 
-    Atoms(const Names_t &n, const Positions_t &p, const Velocities_t &v)
-        : positions{p},
-          velocities{v},
-          forces{3, p.cols()},
-          masses{p.cols()},
-          names{n} {
+    Atoms(const Names_t &n, const Positions_t &p, const Velocities_t &v) : names{n} {
         assert(p.cols() == v.cols());
-        forces.setZero();
-        masses.setOnes();
+        allocate(p.cols());
+        positions = p;
+        velocities = v;
+    }
+
+    // the views have to point to the storage of the copy
+    Atoms(const Atoms &other)
+        : mass_(other.mass_), nb_atoms_(other.nb_atoms_), storage_(other.storage_), names(other.names) {
+        bind();
+    }
+    Atoms(Atoms &&other)
+        : mass_(other.mass_),
+          nb_atoms_(other.nb_atoms_),
+          storage_(std::move(other.storage_)),
+          names(std::move(other.names)) {
+        bind();
+    }
+    Atoms &operator=(Atoms other) {
+        mass_ = other.mass_;
+        nb_atoms_ = other.nb_atoms_;
+        std::swap(storage_, other.storage_);
+        std::swap(names, other.names);
+        bind();
+        return *this;
+    }
+
+    // number of atoms that fit without reallocation
+    size_t capacity() const {
+        return storage_.masses.size();
     }
 
-    void resize(Eigen::Array3Xd &a, size_t size) {
-        size_t original_size = a.cols();
-        Eigen::Array3Xd tmp = a; // should do deepcopy
-        a.resize(3, size); // reallocates memory
-        size_t upper = std::min(original_size, size);
-        a(Eigen::all, Eigen::seq(0, upper - 1)) = tmp(Eigen::all, Eigen::seq(0, upper - 1)); // copy data back
+    // grow the capacity to at least `capacity` atoms, keeping all entries
+    void reserve(size_t capacity) {
+        if (capacity <= this->capacity())
+            return;
+        // The new arrays are first touched in the partition of the kernels
+        // and only then filled with the atoms.
+#ifdef USE_SOA
+        constexpr size_t alignment = ATOMS_ALIGNMENT / sizeof(double);
+        size_t stride = (capacity + alignment - 1) / alignment * alignment;
+        for (auto *vectors : {&storage_.positions, &storage_.velocities, &storage_.forces}) {
+            PerAtomVector<double> grown(3 * stride);
+            for (size_t k = 0; k < 3; k++) {
+                first_touch(grown.data() + k * stride, 0, stride);
+                std::copy_n(vectors->begin() + k * storage_.stride, nb_atoms_, grown.begin() + k * stride);
+            }
+            vectors->swap(grown);
+        }
+        storage_.stride = stride;
+#else
+        for (auto *vectors : {&storage_.positions, &storage_.velocities, &storage_.forces}) {
+            grow(*vectors, 3 * capacity, 3 * nb_atoms_);
+        }
+#endif
+        grow(storage_.masses, capacity, nb_atoms_);
+        grow(storage_.ids, capacity, nb_atoms_);
+        bind();
     }
 
+    // Change the number of atoms, keeping the entries of the remaining atoms.
+    // Shrinking and growing within the capacity neither allocates nor copies;
+    // otherwise the capacity grows by half, such that repeated growth is
+    // amortized. Added atoms get the common mass, everything else about them
+    // is undefined.
     void resize(size_t size) {
-        resize(positions, size);
-        resize(velocities, size);
-        resize(forces, size);
-        masses.resize(size);
-        masses.fill(mass_); // masses are the same anyways
-        // no need to resize names
-        // names.resize(size); // vector resize preserves data
+        if (size > capacity()) {
+            reserve(std::max(size, capacity() + capacity() / 2));
+        }
+        for (size_t i = nb_atoms_; i < size; i++) {
+            storage_.masses[i] = mass_;
+        }
+        nb_atoms_ = size;
+        bind();
+    }
+
+    // name of atom `i`
+    const std::string &name(Eigen::Index i) const {
+        return names[ids(i)];
+    }
+
+    // reorder the atoms by their ids, e.g. into their initial order after
+    // they were gathered from all domains
+    void sort_by_id() {
+        std::vector<Eigen::Index> order(nb_atoms_);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [this](Eigen::Index a, Eigen::Index b) { return ids(a) < ids(b); });
+        positions = Positions_t{positions(Eigen::all, order)};
+        velocities = Velocities_t{velocities(Eigen::all, order)};
+        forces = Forces_t{forces(Eigen::all, order)};
+        masses = Masses_t{masses(order)};
+        ids = Ids_t{ids(order)};
     }
 
     void set_mass(double mass) {
@@ -103,7 +250,7 @@ class Atoms {
     }
 
     size_t nb_atoms() const {
-        return positions.cols();
+        return nb_atoms_;
     }
 
     double kinetic_energy() const {
@@ -124,6 +271,16 @@ class Atoms {
       return kinetic_energy(max_atoms) / (max_atoms * k_B) * 2 / 3;
     }
 
+    // returns the temperature in 1e-5 * K that corresponds to the kinetic
+    // energy `ekin` of the first `max_atoms` atoms (default all)
+    double temperature(double ekin) const {
+      return temperature(ekin, nb_atoms());
+    }
+    double temperature(double ekin, int max_atoms) const {
+      double k_B = 8.617333262;
+      return ekin / (max_atoms * k_B) * 2 / 3;
+    }
+
     // returns temperature in Kelvin
     double current_temperature_kelvin() const {
       return current_temperature() * 1e5;
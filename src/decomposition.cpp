@@ -0,0 +1,67 @@
+#include "decomposition.h"
+#include <algorithm>
+#include <limits>
+
+// length of the overlap of [a0, a1] and [b0, b1]
+static double overlap(double a0, double a1, double b0, double b1) {
+    return std::max(0.0, std::min(a1, b1) - std::max(a0, b0));
+}
+
+DecompositionEstimate estimate_decomposition(const Eigen::Array3i &decomposition, double nb_atoms,
+                                             const Eigen::Array3d &lower, const Eigen::Array3d &upper,
+                                             const Eigen::Array3d &domain_length, const Eigen::Array3i &periodic,
+                                             double border) {
+    // The subdomains are the products of slabs along the three directions,
+    // so the busiest one is the product of the busiest slabs. Per direction,
+    // `extent` is the length occupied by atoms, `own` the largest part of it
+    // within a slab and `seen` the largest part within a slab widened by the
+    // border, i.e. own atoms plus ghosts.
+    double extent = 1, own = 1, seen = 1, mean = 1;
+    for (int dim = 0; dim < 3; dim++) {
+        int n = decomposition(dim);
+        double width = domain_length(dim) / n;
+        if (periodic(dim)) {
+            extent *= domain_length(dim);
+            own *= width;
+            seen *= width + 2 * border;
+        } else {
+            // a layer of atoms is about as thick as their interaction range
+            double center = (lower(dim) + upper(dim)) / 2;
+            double length = std::max(upper(dim) - lower(dim), border);
+            double lo = center - length / 2, hi = center + length / 2;
+            double max_own = 0, max_seen = 0;
+            for (int i = 0; i < n; i++) {
+                max_own = std::max(max_own, overlap(i * width, (i + 1) * width, lo, hi));
+                max_seen = std::max(max_seen, overlap(i * width - border, (i + 1) * width + border, lo, hi));
+            }
+            extent *= length;
+            own *= max_own;
+            seen *= max_seen;
+        }
+        mean /= n;
+    }
+    return {decomposition, nb_atoms * seen / extent, own / (extent * mean)};
+}
+
+DecompositionEstimate choose_decomposition(int nb_processes, double nb_atoms, const Eigen::Array3d &lower,
+                                           const Eigen::Array3d &upper, const Eigen::Array3d &domain_length,
+                                           const Eigen::Array3i &periodic, double border) {
+    DecompositionEstimate best{{1, 1, nb_processes}, std::numeric_limits<double>::infinity(), 0};
+    for (int x = 1; x <= nb_processes; x++) {
+        if (nb_processes % x != 0) {
+            continue;
+        }
+        for (int y = 1; y <= nb_processes / x; y++) {
+            if (nb_processes / x % y != 0) {
+                continue;
+            }
+            auto estimate{estimate_decomposition({x, y, nb_processes / x / y}, nb_atoms, lower, upper,
+                                                 domain_length, periodic, border)};
+            // up to rounding, ties keep the earlier decomposition
+            if (estimate.atoms < best.atoms * (1 - 1e-12)) {
+                best = estimate;
+            }
+        }
+    }
+    return best;
+}
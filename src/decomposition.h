@@ -0,0 +1,38 @@
+#ifndef __DECOMPOSITION_H
+#define __DECOMPOSITION_H
+
+#include <Eigen/Dense>
+
+// Estimated cost of splitting a box into a Cartesian grid of subdomains, one
+// per process, under the assumption that the atoms fill their bounding box
+// with uniform density.
+struct DecompositionEstimate {
+    // number of subdomains in x, y, z direction
+    Eigen::Array3i decomposition;
+    // atoms of the busiest subdomain, its own ones plus its ghosts
+    double atoms;
+    // own atoms of the busiest subdomain over the mean over all subdomains
+    double imbalance;
+};
+
+// Estimate the cost of `decomposition` for `nb_atoms` atoms within
+// [`lower`, `upper`] of a box [0, `domain_length`], with ghosts within
+// `border` of every subdomain. Along periodic directions the atoms are
+// assumed to fill the whole box and a subdomain sees ghosts on both sides,
+// even if it spans the box.
+DecompositionEstimate estimate_decomposition(const Eigen::Array3i &decomposition, double nb_atoms,
+                                             const Eigen::Array3d &lower, const Eigen::Array3d &upper,
+                                             const Eigen::Array3d &domain_length, const Eigen::Array3i &periodic,
+                                             double border);
+
+// Among all factorizations of `nb_processes` into three factors, the
+// decomposition whose busiest subdomain holds the fewest atoms including
+// ghosts, see estimate_decomposition. This trades the ghost volume, which
+// favors cubic subdomains, against the load imbalance of subdomains that cut
+// through empty parts of the box. Ties go to the decomposition that splits
+// z before y before x.
+DecompositionEstimate choose_decomposition(int nb_processes, double nb_atoms, const Eigen::Array3d &lower,
+                                           const Eigen::Array3d &upper, const Eigen::Array3d &domain_length,
+                                           const Eigen::Array3i &periodic, double border);
+
+#endif // __DECOMPOSITION_H
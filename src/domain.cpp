@@ -22,6 +22,8 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <sstream>
 
@@ -53,6 +55,29 @@ Domain::Domain(const MPI_Comm &comm, const Eigen::Array3d &domain_length,
 
     _update_offsets();
 
+    // Neighbors on the same node exchange ghost positions through shared
+    // memory, see update_ghost_positions.
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(comm_, MPI_COMM_TYPE_SHARED, rank_, MPI_INFO_NULL,
+                        &node_comm);
+    MPI_Group group, node_group;
+    MPI_Comm_group(comm_, &group);
+    MPI_Comm_group(node_comm, &node_group);
+    auto node_rank{[&](int rank) {
+        int node_rank{MPI_UNDEFINED};
+        if (rank != MPI_PROC_NULL) {
+            MPI_Group_translate_ranks(group, 1, &rank, node_group, &node_rank);
+        }
+        return node_rank;
+    }};
+    for (int dim{0}; dim < 3; ++dim) {
+        node_left_(dim) = node_rank(left_(dim));
+        node_right_(dim) = node_rank(right_(dim));
+    }
+    MPI_Group_free(&group);
+    MPI_Group_free(&node_group);
+    ghost_window_ = std::make_shared<MPI::SharedWindow>(node_comm);
+
     if (verbose) {
         std::cout << "Rank " << rank_ << " has coordinate "
               << coordinate_.transpose() << "." << std::endl;
@@ -61,6 +86,37 @@ Domain::Domain(const MPI_Comm &comm, const Eigen::Array3d &domain_length,
 
 Domain::~Domain() {}
 
+/*
+ * Gather the positions of the atoms `indices`, shifted by `offset`, into the
+ * columns of `buffer`. Threads share the atoms.
+ */
+template <typename B>
+static void gather_positions(B &&buffer, const Vectors_t &positions,
+                             const Eigen::ArrayXi &indices,
+                             const Eigen::Array3d &offset) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (Eigen::Index k = 0; k < indices.size(); ++k) {
+        buffer.col(k) = positions.col(indices(k)) + offset;
+    }
+}
+
+/*
+ * Gather the values of the atoms `indices` into `buffer`. Threads share the
+ * atoms.
+ */
+template <typename B>
+static void gather_values(B &&buffer, const Eigen::Ref<const Eigen::ArrayXd> &values,
+                          const Eigen::ArrayXi &indices) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (Eigen::Index k = 0; k < indices.size(); ++k) {
+        buffer(k) = values(indices(k));
+    }
+}
+
 void Domain::_update_offsets() {
     // Determine offsets for periodic boundary conditions.
     offset_left_ = (coordinate_ == 0)
@@ -89,6 +145,7 @@ void Domain::enable(Atoms &atoms) {
             // This atom resides in the local domain. We need to add it to the
             // domain-local atoms array.
             atoms.masses(local_index) = global_atoms.masses(global_index);
+            atoms.ids(local_index) = global_atoms.ids(global_index);
             atoms.positions.col(local_index) =
                 global_atoms.positions.col(global_index);
             atoms.velocities.col(local_index) =
@@ -108,6 +165,97 @@ void Domain::enable(Atoms &atoms) {
     is_enabled_ = true;
 }
 
+void Domain::distribute(Atoms &atoms) {
+    // This only works if decomposition is disabled.
+    assert_disabled();
+
+    Arena &arena{step_arena()};
+    Arena::Scope scope{arena};
+
+    // Rank of the subdomain of every atom. Along periodic directions the
+    // positions are wrapped into the domain first, such that every atom lies
+    // within the subdomain it is sent to.
+    auto destinations{arena.map<Eigen::ArrayXi>(atoms.nb_atoms())};
+    std::vector<int> sendcounts(size_, 0), recvcounts(size_),
+        senddispls(size_, 0), recvdispls(size_, 0);
+    for (Eigen::Index i{0}; i < destinations.size(); ++i) {
+        auto &&position{atoms.positions.col(i)};
+        for (int dim{0}; dim < 3; ++dim) {
+            if (periodicity_(dim)) {
+                position(dim) -= std::floor(position(dim) / domain_length_(dim)) *
+                                 domain_length_(dim);
+                // tiny negative positions round up to the length
+                if (position(dim) >= domain_length_(dim)) {
+                    position(dim) -= domain_length_(dim);
+                }
+            }
+        }
+        Eigen::Array3i coordinate{get_coordinate(position)};
+        for (int dim{0}; dim < 3; ++dim) {
+            coordinate(dim) =
+                periodicity_(dim)
+                    ? wrap_to_interval(coordinate(dim), decomposition_(dim))
+                    : std::clamp(coordinate(dim), 0, decomposition_(dim) - 1);
+        }
+        MPI_Cart_rank(comm_, coordinate.data(), &destinations(i));
+        sendcounts[destinations(i)]++;
+    }
+
+    // Pack the atoms ordered by their destinations, keeping their order
+    // otherwise. We need full particle information. Ids go into a buffer of
+    // their own, doubles only hold them exactly up to 2^53.
+    constexpr int nb_values{7};
+    for (int i{1}; i < size_; ++i) {
+        senddispls[i] = senddispls[i - 1] + sendcounts[i - 1];
+    }
+    auto send{arena.map<Eigen::Array<double, nb_values, Eigen::Dynamic>>(
+        nb_values, atoms.nb_atoms())};
+    auto send_ids{arena.map<Eigen::Array<int64_t, Eigen::Dynamic, 1>>(
+        atoms.nb_atoms())};
+    std::vector<int> next(senddispls);
+    for (Eigen::Index i{0}; i < destinations.size(); ++i) {
+        auto k{next[destinations(i)]++};
+        auto &&column{send.col(k)};
+        column(0) = atoms.masses(i);
+        column.segment<3>(1) = atoms.positions.col(i);
+        column.segment<3>(4) = atoms.velocities.col(i);
+        send_ids(k) = atoms.ids(i);
+    }
+
+    MPI_Alltoall(sendcounts.data(), 1, MPI_INT, recvcounts.data(), 1, MPI_INT,
+                 comm_);
+    for (int i{1}; i < size_; ++i) {
+        recvdispls[i] = recvdispls[i - 1] + recvcounts[i - 1];
+    }
+    int nb_recv{recvdispls[size_ - 1] + recvcounts[size_ - 1]};
+    auto recv{arena.map<Eigen::Array<double, nb_values, Eigen::Dynamic>>(
+        nb_values, nb_recv)};
+    auto recv_ids{
+        arena.map<Eigen::Array<int64_t, Eigen::Dynamic, 1>>(nb_recv)};
+    MPI_Alltoallv(send_ids.data(), sendcounts.data(), senddispls.data(),
+                  MPI_INT64_T, recv_ids.data(), recvcounts.data(),
+                  recvdispls.data(), MPI_INT64_T, comm_);
+    for (auto *counts : {&sendcounts, &senddispls, &recvcounts, &recvdispls}) {
+        for (auto &&count : *counts) {
+            count *= nb_values;
+        }
+    }
+    MPI_Alltoallv(send.data(), sendcounts.data(), senddispls.data(), MPI_DOUBLE,
+                  recv.data(), recvcounts.data(), recvdispls.data(),
+                  MPI_DOUBLE, comm_);
+
+    // Unpack, atoms of lower ranks first.
+    atoms.resize(nb_recv);
+    atoms.masses = recv.row(0).transpose();
+    atoms.ids = recv_ids;
+    atoms.positions = recv.middleRows<3>(1);
+    atoms.velocities = recv.middleRows<3>(4);
+    atoms.forces.setZero();
+    nb_local_ = nb_recv;
+
+    is_enabled_ = true;
+}
+
 void Domain::disable(Atoms &atoms) {
     // This method only works if decomposition is enabled.
     assert_enabled();
@@ -135,6 +283,23 @@ void Domain::disable(Atoms &atoms) {
     MPI_Allgatherv(local_atoms.masses.data(), nb_local_, MPI_DOUBLE,
                    atoms.masses.data(), recvcount.data(), displ.data(),
                    MPI_DOUBLE, comm_);
+    MPI_Allgatherv(local_atoms.ids.data(), nb_local_, MPI_INT64_T,
+                   atoms.ids.data(), recvcount.data(), displ.data(),
+                   MPI_INT64_T, comm_);
+#ifdef USE_SOA
+    // Every coordinate is a contiguous row of its own.
+    for (int d = 0; d < 3; d++) {
+        MPI_Allgatherv(local_atoms.positions.row(d).data(), nb_local_, MPI_DOUBLE,
+                       atoms.positions.row(d).data(), recvcount.data(), displ.data(),
+                       MPI_DOUBLE, comm_);
+        MPI_Allgatherv(local_atoms.velocities.row(d).data(), nb_local_, MPI_DOUBLE,
+                       atoms.velocities.row(d).data(), recvcount.data(), displ.data(),
+                       MPI_DOUBLE, comm_);
+        MPI_Allgatherv(local_atoms.forces.row(d).data(), nb_local_, MPI_DOUBLE,
+                       atoms.forces.row(d).data(), recvcount.data(), displ.data(),
+                       MPI_DOUBLE, comm_);
+    }
+#else
     recvcount *= 3;
     displ *= 3;
     MPI_Allgatherv(local_atoms.positions.data(), 3 * nb_local_, MPI_DOUBLE,
@@ -146,28 +311,42 @@ void Domain::disable(Atoms &atoms) {
     MPI_Allgatherv(local_atoms.forces.data(), 3 * nb_local_, MPI_DOUBLE,
                    atoms.forces.data(), recvcount.data(), displ.data(),
                    MPI_DOUBLE, comm_);
+#endif
+
+    // Restore the initial order of the atoms.
+    atoms.sort_by_id();
 
     is_enabled_ = false;
 }
 
 Eigen::Index Domain::_exchange_atoms(Atoms &atoms, int dim) {
+    // Temporaries live in the step arena.
+    Arena &arena{step_arena()};
+
     // Determine atoms that need to be send to the left and the right.
-    auto domain_coordinates{get_coordinates(atoms.positions, dim)};
+    auto domain_coordinates{arena.map<Eigen::ArrayXi>(atoms.nb_atoms())};
+    domain_coordinates = get_coordinates(atoms.positions, dim);
     auto left_mask{domain_coordinates < coordinate_(dim)};
     auto right_mask{domain_coordinates > coordinate_(dim)};
 
-    // Pack send buffers. We need full particle information.
+    // Pack send buffers. We need full particle information. Ids go into
+    // buffers of their own, doubles only hold them exactly up to 2^53.
     auto send_left{MPI::Eigen::pack_buffer(
-        left_mask, atoms.masses, atoms.positions.row(0) + offset_left_(0, dim),
+        arena, left_mask, atoms.masses,
+        atoms.positions.row(0) + offset_left_(0, dim),
         atoms.positions.row(1) + offset_left_(1, dim),
         atoms.positions.row(2) + offset_left_(2, dim), atoms.velocities.row(0),
         atoms.velocities.row(1), atoms.velocities.row(2))};
     auto send_right{MPI::Eigen::pack_buffer(
-        right_mask, atoms.masses,
+        arena, right_mask, atoms.masses,
         atoms.positions.row(0) + offset_right_(0, dim),
         atoms.positions.row(1) + offset_right_(1, dim),
         atoms.positions.row(2) + offset_right_(2, dim), atoms.velocities.row(0),
         atoms.velocities.row(1), atoms.velocities.row(2))};
+    auto send_left_ids{
+        MPI::Eigen::pack_buffer<int64_t>(arena, left_mask, atoms.ids)};
+    auto send_right_ids{
+        MPI::Eigen::pack_buffer<int64_t>(arena, right_mask, atoms.ids)};
 
     // Delete atoms that are send to left and right
     for (int i{nb_local_ - 1}; i >= 0; --i) {
@@ -177,6 +356,7 @@ Eigen::Index Domain::_exchange_atoms(Atoms &atoms, int dim) {
             if (i != nb_local_) {
                 // If it is not the last atom, we the last atom here
                 atoms.masses(i) = atoms.masses(nb_local_);
+                atoms.ids(i) = atoms.ids(nb_local_);
                 atoms.positions.col(i) = atoms.positions.col(nb_local_);
                 atoms.velocities.col(i) = atoms.velocities.col(nb_local_);
             }
@@ -185,9 +365,15 @@ Eigen::Index Domain::_exchange_atoms(Atoms &atoms, int dim) {
 
     // Communicate buffers.
     auto recv_right{
-        MPI::Eigen::sendrecv(send_left, left_(dim), right_(dim), comm_)};
+        MPI::Eigen::sendrecv(arena, send_left, left_(dim), right_(dim), comm_)};
     auto recv_left{
-        MPI::Eigen::sendrecv(send_right, right_(dim), left_(dim), comm_)};
+        MPI::Eigen::sendrecv(arena, send_right, right_(dim), left_(dim), comm_)};
+    auto recv_right_ids{MPI::Eigen::sendrecv(arena, send_left_ids,
+                                             recv_right.cols(), left_(dim),
+                                             right_(dim), comm_)};
+    auto recv_left_ids{MPI::Eigen::sendrecv(arena, send_right_ids,
+                                            recv_left.cols(), right_(dim),
+                                            left_(dim), comm_)};
 
     // Resize atoms array. This will discard all ghost atoms.
     atoms.resize(nb_local_ + recv_left.cols() + recv_right.cols());
@@ -202,6 +388,9 @@ Eigen::Index Domain::_exchange_atoms(Atoms &atoms, int dim) {
                               atoms.positions.row(1), atoms.positions.row(2),
                               atoms.velocities.row(0), atoms.velocities.row(1),
                               atoms.velocities.row(2));
+    MPI::Eigen::unpack_buffer(recv_left_ids, nb_local_, atoms.ids);
+    MPI::Eigen::unpack_buffer(recv_right_ids, nb_local_ + recv_left.cols(),
+                              atoms.ids);
 
     // Update number of process-local atoms.
     assert(nb_local_ + recv_left.cols() + recv_right.cols() ==
@@ -215,8 +404,12 @@ void Domain::exchange_atoms(Atoms &atoms) {
     // This method only works if decomposition is enabled.
     assert_enabled();
 
+    // Release the send and receive buffers at the end.
+    Arena::Scope scope{step_arena()};
+
     // Invalidate ghosts (we don't want to send those).
     atoms.resize(nb_local_);
+    ghost_exchanges_.clear();
 
     // Loop as long as there is something left to be send. Multiple iterations
     // happen if atoms are farther than one subdomain away from where they
@@ -259,21 +452,61 @@ Domain::_update_ghosts(Atoms &atoms, double border_width, int dim,
     auto right_mask{right_positions.row(dim) >
                     right_domain_boundary - border_width};
 
-    // Pack send buffers. We only need positions.
-    auto send_left{MPI::Eigen::pack_buffer(
-        left_mask, left_positions.row(0) + offset_left_(0, dim),
-        left_positions.row(1) + offset_left_(1, dim),
-        left_positions.row(2) + offset_left_(2, dim))};
-    auto send_right{MPI::Eigen::pack_buffer(
-        right_mask, right_positions.row(0) + offset_right_(0, dim),
-        right_positions.row(1) + offset_right_(1, dim),
-        right_positions.row(2) + offset_right_(2, dim))};
+    // Atoms that need to be sent. The index lists are kept, such that
+    // positions and per-atom values can later be sent along the same way.
+    auto send_left_indices{MPI::Eigen::mask_to_indices(left_mask, left_start)};
+    auto send_right_indices{
+        MPI::Eigen::mask_to_indices(right_mask, right_start)};
+
+    // Pack send buffers by gathering over the index lists. We need
+    // positions, and ids and owners in integer buffers of their own.
+    Arena &arena{step_arena()};
+    Eigen::Map<Eigen::ArrayXi> owners(owners_.data(), owners_.size());
+    auto send_left{MPI::Eigen::gather_buffer(
+        arena, send_left_indices,
+        atoms.positions.row(0) + offset_left_(0, dim),
+        atoms.positions.row(1) + offset_left_(1, dim),
+        atoms.positions.row(2) + offset_left_(2, dim))};
+    auto send_right{MPI::Eigen::gather_buffer(
+        arena, send_right_indices,
+        atoms.positions.row(0) + offset_right_(0, dim),
+        atoms.positions.row(1) + offset_right_(1, dim),
+        atoms.positions.row(2) + offset_right_(2, dim))};
+    auto send_left_ids{MPI::Eigen::gather_buffer<int64_t>(
+        arena, send_left_indices, atoms.ids, owners)};
+    auto send_right_ids{MPI::Eigen::gather_buffer<int64_t>(
+        arena, send_right_indices, atoms.ids, owners)};
+
+    // Neighbors on the same node will read later positions from two slots
+    // of the shared segment of this process; tell them where those are.
+    bool shared_left{node_left_(dim) != MPI_UNDEFINED},
+        shared_right{node_right_(dim) != MPI_UNDEFINED};
+    Eigen::Index shared_send_left{ghost_segment_size_};
+    if (shared_left) {
+        ghost_segment_size_ += 2 * 3 * send_left_indices.size();
+    }
+    Eigen::Index shared_send_right{ghost_segment_size_};
+    if (shared_right) {
+        ghost_segment_size_ += 2 * 3 * send_right_indices.size();
+    }
+    auto shared_recv_right{MPI::sendrecv<long long>(
+        shared_send_left, shared_left ? left_(dim) : MPI_PROC_NULL,
+        shared_right ? right_(dim) : MPI_PROC_NULL, comm_)};
+    auto shared_recv_left{MPI::sendrecv<long long>(
+        shared_send_right, shared_right ? right_(dim) : MPI_PROC_NULL,
+        shared_left ? left_(dim) : MPI_PROC_NULL, comm_)};
 
     // Send and receive buffers.
     auto recv_right{
-        MPI::Eigen::sendrecv(send_left, left_(dim), right_(dim), comm_)};
+        MPI::Eigen::sendrecv(arena, send_left, left_(dim), right_(dim), comm_)};
     auto recv_left{
-        MPI::Eigen::sendrecv(send_right, right_(dim), left_(dim), comm_)};
+        MPI::Eigen::sendrecv(arena, send_right, right_(dim), left_(dim), comm_)};
+    auto recv_right_ids{MPI::Eigen::sendrecv(arena, send_left_ids,
+                                             recv_right.cols(), left_(dim),
+                                             right_(dim), comm_)};
+    auto recv_left_ids{MPI::Eigen::sendrecv(arena, send_right_ids,
+                                            recv_left.cols(), right_(dim),
+                                            left_(dim), comm_)};
 
     // Resize Atoms object to store additional ghost atoms. Note that this
     // invalidates left_mask and right_mask and we cannot use this after this
@@ -281,12 +514,27 @@ Domain::_update_ghosts(Atoms &atoms, double border_width, int dim,
     auto nb_last{atoms.nb_atoms()};
     atoms.resize(nb_last + recv_left.cols() + recv_right.cols());
 
+    Eigen::Index recv_left_start(nb_last);
+    ghost_exchanges_.push_back({dim, send_left_indices, send_right_indices,
+                                recv_left_start,
+                                recv_left_start + recv_left.cols(),
+                                recv_left.cols(), recv_right.cols(),
+                                (send_left_indices >= nb_local_).any() ||
+                                    (send_right_indices >= nb_local_).any(),
+                                shared_send_left, shared_send_right,
+                                shared_recv_left, shared_recv_right});
+
     // Unpack receive buffers.
+    owners_.resize(atoms.nb_atoms());
+    Eigen::Map<Eigen::ArrayXi> recv_owners(owners_.data(), owners_.size());
     MPI::Eigen::unpack_buffer(recv_left, nb_last, atoms.positions.row(0),
                               atoms.positions.row(1), atoms.positions.row(2));
     MPI::Eigen::unpack_buffer(recv_right, nb_last + recv_left.cols(),
                               atoms.positions.row(0), atoms.positions.row(1),
                               atoms.positions.row(2));
+    MPI::Eigen::unpack_buffer(recv_left_ids, nb_last, atoms.ids, recv_owners);
+    MPI::Eigen::unpack_buffer(recv_right_ids, nb_last + recv_left.cols(),
+                              atoms.ids, recv_owners);
 
     return {recv_left.cols(), recv_right.cols()};
 }
@@ -295,8 +543,14 @@ void Domain::update_ghosts(Atoms &atoms, double border_width) {
     // This method only works if decomposition is enabled.
     assert_enabled();
 
+    // Release the send and receive buffers at the end.
+    Arena::Scope scope{step_arena()};
+
     // Remove all ghosts.
     atoms.resize(nb_local_);
+    ghost_exchanges_.clear();
+    ghost_segment_size_ = 0;
+    owners_.assign(nb_local_, rank_);
 
     // Loop over all Cartesian dimensions
     for (int dim{0}; dim < 3; ++dim) {
@@ -336,6 +590,254 @@ void Domain::update_ghosts(Atoms &atoms, double border_width) {
                 MPI::allreduce(nb_recv_left + nb_recv_right, MPI_SUM, comm_);
         }
     }
+
+    // Slots for the positions sent to neighbors on the same node.
+    ghost_window_->reserve(ghost_segment_size_);
+}
+
+void Domain::GhostUpdate::begin(size_t nb_exchanges, size_t nb_send,
+                                size_t nb_recv) {
+    // MPI cannot send from or receive into NULL, the buffers are never empty.
+    send_buffer.resize(nb_send + 1);
+    recv_buffer.resize(nb_recv + 1);
+    send_offset = 0;
+    nb_sends = 0;
+    nb_unpacked = 0;
+    recv_requests.resize(2 * nb_exchanges);
+    send_requests.resize(2 * nb_exchanges);
+}
+
+void Domain::update_ghost_positions(Atoms &atoms) {
+    begin_update_ghost_positions(atoms);
+    finish_update_ghost_positions(atoms);
+}
+
+std::array<Eigen::Map<Eigen::Array3Xd>, 2>
+Domain::_send_position_buffers(size_t e) {
+    auto &&exchange{ghost_exchanges_[e]};
+    MPI::SharedWindow &window{*ghost_window_};
+    double *segment{window.segment(MPI::comm_rank(window.communicator()))};
+    Eigen::Index nb_left{exchange.send_left.size()},
+        nb_right{exchange.send_right.size()};
+    double *buffer{position_update_.send_buffer.data() +
+                   position_send_offsets_[e]};
+    double *left{node_left_(exchange.dim) != MPI_UNDEFINED
+                     ? segment + exchange.shared_send_left +
+                           ghost_slot_ * 3 * nb_left
+                     : buffer};
+    double *right{node_right_(exchange.dim) != MPI_UNDEFINED
+                      ? segment + exchange.shared_send_right +
+                            ghost_slot_ * 3 * nb_right
+                      : buffer + 3 * nb_left};
+    return {{Eigen::Map<Eigen::Array3Xd>(left, 3, nb_left),
+             Eigen::Map<Eigen::Array3Xd>(right, 3, nb_right)}};
+}
+
+std::array<Eigen::Map<Eigen::Array3Xd>, 2>
+Domain::_recv_position_buffers(size_t e) {
+    auto &&exchange{ghost_exchanges_[e]};
+    MPI::SharedWindow &window{*ghost_window_};
+    Eigen::Index nb_left{exchange.nb_recv_left},
+        nb_right{exchange.nb_recv_right};
+    double *buffer{position_update_.recv_buffer.data() +
+                   position_recv_offsets_[e]};
+    double *left{node_left_(exchange.dim) != MPI_UNDEFINED
+                     ? window.segment(node_left_(exchange.dim)) +
+                           exchange.shared_recv_left + ghost_slot_ * 3 * nb_left
+                     : buffer};
+    double *right{node_right_(exchange.dim) != MPI_UNDEFINED
+                      ? window.segment(node_right_(exchange.dim)) +
+                            exchange.shared_recv_right +
+                            ghost_slot_ * 3 * nb_right
+                      : buffer + 3 * nb_left};
+    return {{Eigen::Map<Eigen::Array3Xd>(left, 3, nb_left),
+             Eigen::Map<Eigen::Array3Xd>(right, 3, nb_right)}};
+}
+
+void Domain::begin_update_ghost_positions(Atoms &atoms) {
+    // This method only works if decomposition is enabled.
+    assert_enabled();
+    if (!ghosts_valid()) {
+        throw std::runtime_error("Ghosts are not valid. Use `update_ghosts` "
+                                 "to communicate them.");
+    }
+
+    // Replay all exchanges in the order in which they happened, such that
+    // positions of ghosts that are forwarded have been received before. All
+    // message sizes are known, so there is no need to negotiate them, and
+    // every exchange has its own part of the send and receive buffers.
+    // Positions for neighbors on the same node are packed into the current
+    // slots of the shared segment instead of a send buffer, and positions
+    // from them are copied straight out of their segments; the messages to
+    // and from them are empty and only order the accesses.
+    size_t nb_exchanges{ghost_exchanges_.size()};
+    position_send_offsets_.resize(nb_exchanges + 1);
+    position_recv_offsets_.resize(nb_exchanges + 1);
+    position_send_offsets_[0] = position_recv_offsets_[0] = 0;
+    for (size_t e{0}; e < nb_exchanges; ++e) {
+        auto &&exchange{ghost_exchanges_[e]};
+        position_send_offsets_[e + 1] =
+            position_send_offsets_[e] +
+            3 * (exchange.send_left.size() + exchange.send_right.size());
+        position_recv_offsets_[e + 1] =
+            position_recv_offsets_[e] +
+            3 * (exchange.nb_recv_left + exchange.nb_recv_right);
+    }
+    position_update_.begin(nb_exchanges, position_send_offsets_.back(),
+                           position_recv_offsets_.back());
+
+    for (size_t e{0}; e < nb_exchanges; ++e) {
+        int dim{ghost_exchanges_[e].dim};
+        bool shared_left{node_left_(dim) != MPI_UNDEFINED},
+            shared_right{node_right_(dim) != MPI_UNDEFINED};
+        auto [recv_left, recv_right]{_recv_position_buffers(e)};
+        MPI_Irecv(shared_right ? dummy_recv_buffer_ : recv_right.data(),
+                  shared_right ? 0 : recv_right.size(), MPI_DOUBLE,
+                  right_(dim), 2 * e, comm_,
+                  &position_update_.recv_requests[2 * e]);
+        MPI_Irecv(shared_left ? dummy_recv_buffer_ : recv_left.data(),
+                  shared_left ? 0 : recv_left.size(), MPI_DOUBLE, left_(dim),
+                  2 * e + 1, comm_, &position_update_.recv_requests[2 * e + 1]);
+    }
+
+    // Send positions of local atoms right away. Exchanges that forward
+    // ghosts have to wait for the positions of those.
+    while (position_update_.nb_sends < nb_exchanges &&
+           !ghost_exchanges_[position_update_.nb_sends].forwards) {
+        _send_ghost_positions(atoms);
+    }
+}
+
+void Domain::finish_update_ghost_positions(Atoms &atoms) {
+    // Replay the remaining exchanges, waiting for the positions of ghosts
+    // received before each of them.
+    while (position_update_.nb_sends < ghost_exchanges_.size()) {
+        position_update_.wait_sent();
+        _unpack_ghost_positions(atoms, position_update_.nb_sends);
+        _send_ghost_positions(atoms);
+    }
+    position_update_.wait_all();
+    _unpack_ghost_positions(atoms, ghost_exchanges_.size());
+
+    // The next update uses the other slots of the shared segments.
+    ghost_slot_ = 1 - ghost_slot_;
+}
+
+void Domain::_send_ghost_positions(const Atoms &atoms) {
+    size_t e{position_update_.nb_sends++};
+    auto &&exchange{ghost_exchanges_[e]};
+    int dim{exchange.dim};
+    bool shared_left{node_left_(dim) != MPI_UNDEFINED},
+        shared_right{node_right_(dim) != MPI_UNDEFINED};
+    auto [send_left, send_right]{_send_position_buffers(e)};
+    gather_positions(send_left, atoms.positions, exchange.send_left,
+                     offset_left_.col(dim).array());
+    gather_positions(send_right, atoms.positions, exchange.send_right,
+                     offset_right_.col(dim).array());
+
+    // Positions in the shared segment are visible before the message that
+    // announces them.
+    if (shared_left || shared_right) {
+        ghost_window_->sync();
+    }
+    MPI_Isend(send_left.data(), shared_left ? 0 : send_left.size(), MPI_DOUBLE,
+              left_(dim), 2 * e, comm_, &position_update_.send_requests[2 * e]);
+    MPI_Isend(send_right.data(), shared_right ? 0 : send_right.size(),
+              MPI_DOUBLE, right_(dim), 2 * e + 1, comm_,
+              &position_update_.send_requests[2 * e + 1]);
+}
+
+void Domain::_unpack_ghost_positions(Atoms &atoms, size_t nb_exchanges) {
+    if (position_update_.nb_unpacked == nb_exchanges) {
+        return;
+    }
+    // Positions that neighbors wrote into their segments are visible after
+    // their messages arrived.
+    ghost_window_->sync();
+    for (size_t e{position_update_.nb_unpacked}; e < nb_exchanges; ++e) {
+        auto &&exchange{ghost_exchanges_[e]};
+        auto [recv_left, recv_right]{_recv_position_buffers(e)};
+        atoms.positions.middleCols(exchange.recv_left_start,
+                                   exchange.nb_recv_left) = recv_left;
+        atoms.positions.middleCols(exchange.recv_right_start,
+                                   exchange.nb_recv_right) = recv_right;
+    }
+    position_update_.nb_unpacked = nb_exchanges;
+}
+
+void Domain::update_ghost_values(Eigen::Ref<Eigen::ArrayXd> values) {
+    begin_update_ghost_values(values);
+    finish_update_ghost_values(values);
+}
+
+void Domain::begin_update_ghost_values(Eigen::Ref<Eigen::ArrayXd> values) {
+    // This method only works if decomposition is enabled.
+    assert_enabled();
+
+    // MPI cannot receive into NULL, we hence use a dummy buffer when there is
+    // nothing to receive.
+    auto recv_buffer{[&](Eigen::Index start) {
+        return values.size() > start ? values.data() + start
+                                     : dummy_recv_buffer_;
+    }};
+
+    // Values are received straight into the slots of the ghosts.
+    size_t nb_exchanges{ghost_exchanges_.size()}, nb_send{0};
+    for (auto &&exchange : ghost_exchanges_) {
+        nb_send += exchange.send_left.size() + exchange.send_right.size();
+    }
+    value_update_.begin(nb_exchanges, nb_send, 0);
+
+    // Every ghost has its own slot, so all receives can be posted at once.
+    // The tag identifies the exchange and the direction.
+    for (size_t e{0}; e < nb_exchanges; ++e) {
+        auto &&exchange{ghost_exchanges_[e]};
+        assert(exchange.recv_right_start + exchange.nb_recv_right <=
+               values.size());
+        MPI_Irecv(recv_buffer(exchange.recv_right_start),
+                  exchange.nb_recv_right, MPI_DOUBLE, right_(exchange.dim),
+                  2 * e, comm_, &value_update_.recv_requests[2 * e]);
+        MPI_Irecv(recv_buffer(exchange.recv_left_start), exchange.nb_recv_left,
+                  MPI_DOUBLE, left_(exchange.dim), 2 * e + 1, comm_,
+                  &value_update_.recv_requests[2 * e + 1]);
+    }
+
+    // Send values of local atoms right away. Exchanges that forward ghosts
+    // have to wait for the values of those.
+    while (value_update_.nb_sends < nb_exchanges &&
+           !ghost_exchanges_[value_update_.nb_sends].forwards) {
+        _send_ghost_values(values);
+    }
+}
+
+void Domain::finish_update_ghost_values(Eigen::Ref<Eigen::ArrayXd> values) {
+    // Replay the remaining exchanges in the order in which they happened,
+    // waiting for the values of ghosts received before each of them.
+    while (value_update_.nb_sends < ghost_exchanges_.size()) {
+        value_update_.wait_sent();
+        _send_ghost_values(values);
+    }
+    value_update_.wait_all();
+}
+
+void Domain::_send_ghost_values(const Eigen::Ref<const Eigen::ArrayXd> &values) {
+    size_t e{value_update_.nb_sends++};
+    auto &&exchange{ghost_exchanges_[e]};
+    Eigen::Map<Eigen::ArrayXd> send_left(
+        value_update_.send_buffer.data() + value_update_.send_offset,
+        exchange.send_left.size());
+    Eigen::Map<Eigen::ArrayXd> send_right(send_left.data() + send_left.size(),
+                                          exchange.send_right.size());
+    value_update_.send_offset += send_left.size() + send_right.size();
+    gather_values(send_left, values, exchange.send_left);
+    gather_values(send_right, values, exchange.send_right);
+
+    MPI_Isend(send_left.data(), send_left.size(), MPI_DOUBLE,
+              left_(exchange.dim), 2 * e, comm_,
+              &value_update_.send_requests[2 * e]);
+    MPI_Isend(send_right.data(), send_right.size(), MPI_DOUBLE,
+              right_(exchange.dim), 2 * e + 1, comm_,
+              &value_update_.send_requests[2 * e + 1]);
 }
 
 void Domain::scale(Atoms &atoms, Eigen::Array3d domain_length) {
@@ -343,6 +845,7 @@ void Domain::scale(Atoms &atoms, Eigen::Array3d domain_length) {
 
     // Invalidate ghosts.
     atoms.resize(nb_local_);
+    ghost_exchanges_.clear();
 
     // Rescale atomic positions.
     for (auto &&position : atoms.positions.colwise()) {
@@ -27,6 +27,10 @@
 
 #include <mpi.h>
 
+#include <array>
+#include <memory>
+#include <vector>
+
 #include "atoms.h"
 #include "mpi_support.h"
 
@@ -43,9 +47,20 @@ public:
      */
     void enable(Atoms &atoms);
 
+    /*
+     * Enable domain decomposition for atoms that are spread over the
+     * processes in any way, e.g. as read by read_xyz_all: every atom is sent
+     * to the process of its subdomain with a single all-to-all, such that no
+     * process ever holds all atoms. The positions of atoms outside of the
+     * domain are wrapped into it along periodic directions; otherwise these
+     * atoms are assigned to the outermost subdomains.
+     */
+    void distribute(Atoms &atoms);
+
     /*
      * Disable domain decomposition: After this call to this method, all
-     * processes contain identical copies of the Atoms object.
+     * processes contain identical copies of the Atoms object, with the atoms
+     * ordered by their ids.
      */
     void disable(Atoms &atoms);
 
@@ -56,10 +71,67 @@ public:
     void exchange_atoms(Atoms &atoms);
 
     /*
-     * Communicate atoms into the ghost buffers of neighboring cells.
+     * Communicate atoms into the ghost buffers of neighboring cells. Ghosts
+     * carry the ids of their atoms and the ranks that own them.
      */
     void update_ghosts(Atoms &atoms, double border_width);
-    
+
+    /*
+     * Communicate positions of local atoms into the slots of their ghosts.
+     * This replays the communication pattern of the last call to
+     * `update_ghosts`: ghosts keep their slots, ids and owners, and no atoms
+     * change subdomains. Together with a neighbor list skin, this allows to
+     * rebuild ghosts only when the list is rebuilt, provided ghosts were
+     * built with a border width of cutoff plus skin. Neighbors on the same
+     * node do not send positions through MPI: the owner packs them into its
+     * segment of a shared memory window and the neighbor copies them from
+     * there into its ghost slots, only an empty message signals that they
+     * are ready.
+     */
+    void update_ghost_positions(Atoms &atoms);
+
+    /*
+     * Split-phase version of `update_ghost_positions`: `begin` posts all
+     * receives and sends the positions of local atoms, `finish` forwards
+     * positions of ghosts as they arrive, waits for all messages and writes
+     * the positions of all ghosts. Positions of local atoms may be read in
+     * between, e.g. to compute densities of interior atoms, but must not be
+     * modified; ghosts keep their old positions until `finish` returns.
+     */
+    void begin_update_ghost_positions(Atoms &atoms);
+    void finish_update_ghost_positions(Atoms &atoms);
+
+    /*
+     * Is the ghost communication pattern still valid? Exchanging atoms and
+     * rescaling the domain invalidate it.
+     */
+    bool ghosts_valid() const { return !ghost_exchanges_.empty(); }
+
+    /*
+     * Rank that owns atom `i`, the present rank for local atoms.
+     */
+    int owner(Eigen::Index i) const { return i < nb_local_ ? rank_ : owners_[i]; }
+
+    /*
+     * Communicate per-atom values (e.g. embedding densities) from their owners
+     * into the ghost buffers of neighboring cells. This replays the
+     * communication pattern of the last call to `update_ghosts`: `values` must
+     * hold one entry per local and ghost atom and the entries of all ghost
+     * atoms are overwritten.
+     */
+    void update_ghost_values(Eigen::Ref<Eigen::ArrayXd> values);
+
+    /*
+     * Split-phase version of `update_ghost_values`: `begin` posts all
+     * receives and sends the values of local atoms, `finish` forwards values
+     * of ghosts as they arrive and waits for all messages. Values of local
+     * atoms may be read in between, e.g. to compute forces on interior atoms,
+     * but `values` must not be modified or reallocated before `finish` was
+     * called with the same array.
+     */
+    void begin_update_ghost_values(Eigen::Ref<Eigen::ArrayXd> values);
+    void finish_update_ghost_values(Eigen::Ref<Eigen::ArrayXd> values);
+
     /*
      * Set new domain length and (affinely) rescale atom positions.
      */
@@ -129,11 +201,12 @@ protected:
     }
 
     /*
-     * Get domain index given an array of position
+     * Get domain index given an array of position, as an expression that can
+     * be evaluated into any column
      */
-    Eigen::ArrayXi get_coordinates(const Eigen::Array3Xd &positions, int dim) {
+    auto get_coordinates(const Vectors_t &positions, int dim) {
         return (positions.row(dim) * (static_cast<double>(decomposition_(dim) / domain_length_(dim))))
-            .floor().cast<int>();
+            .floor().cast<int>().transpose();
     }
 
     /*
@@ -200,6 +273,100 @@ protected:
 
     // Offsets for periodic boundary conditions
     Eigen::Matrix3d offset_left_, offset_right_;
+
+    /*
+     * Record of a single send/receive step of `update_ghosts`.
+     */
+    struct GhostExchange {
+        // Cartesian direction of the exchange
+        int dim;
+        // Indices of the atoms that were sent to the left and to the right
+        Eigen::ArrayXi send_left, send_right;
+        // Index of the first ghost received from the left and from the right
+        Eigen::Index recv_left_start, recv_right_start;
+        // Number of ghosts received from the left and from the right
+        Eigen::Index nb_recv_left, nb_recv_right;
+        // Does the exchange forward ghosts received in earlier exchanges?
+        bool forwards;
+        // Offsets of the positions sent to neighbors on the same node in the
+        // shared segment of this process, and of those received from them in
+        // the segments of the neighbors, see update_ghost_positions
+        Eigen::Index shared_send_left = 0, shared_send_right = 0, shared_recv_left = 0, shared_recv_right = 0;
+    };
+
+    // Ghost communication pattern of the last call to `update_ghosts`
+    std::vector<GhostExchange> ghost_exchanges_;
+
+    // Owners of all local and ghost atoms
+    std::vector<int> owners_;
+
+    /*
+     * State of a ghost update in flight: send and receive buffers, which
+     * must outlive the scopes of the kernels run in between, the requests of
+     * all exchanges (two per exchange), the number of exchanges sent and of
+     * those whose received positions were written to the ghosts.
+     */
+    struct GhostUpdate {
+        std::vector<double> send_buffer, recv_buffer;
+        size_t send_offset = 0, nb_sends = 0, nb_unpacked = 0;
+        std::vector<MPI_Request> recv_requests, send_requests;
+
+        // size the buffers and requests for `nb_exchanges` exchanges
+        void begin(size_t nb_exchanges, size_t nb_send, size_t nb_recv);
+        // wait for the receives of the exchanges sent so far
+        void wait_sent() {
+            MPI_Waitall(2 * nb_sends, recv_requests.data(),
+                        MPI_STATUSES_IGNORE);
+        }
+        // wait for all messages
+        void wait_all() {
+            MPI_Waitall(recv_requests.size(), recv_requests.data(),
+                        MPI_STATUSES_IGNORE);
+            MPI_Waitall(send_requests.size(), send_requests.data(),
+                        MPI_STATUSES_IGNORE);
+        }
+    };
+    GhostUpdate value_update_, position_update_;
+
+    /*
+     * Post the sends of the next ghost value exchange.
+     */
+    void _send_ghost_values(const Eigen::Ref<const Eigen::ArrayXd> &values);
+
+    /*
+     * Post the sends of the next ghost position exchange, and write the
+     * positions received by the exchanges whose receives completed.
+     */
+    void _send_ghost_positions(const Atoms &atoms);
+    void _unpack_ghost_positions(Atoms &atoms, size_t nb_exchanges);
+
+    /*
+     * Buffers of the positions sent to and received from the left and the
+     * right in exchange `e`: slots of the shared segments for neighbors on
+     * the same node, parts of the buffers of `position_update_` otherwise.
+     */
+    std::array<Eigen::Map<Eigen::Array3Xd>, 2> _send_position_buffers(size_t e);
+    std::array<Eigen::Map<Eigen::Array3Xd>, 2> _recv_position_buffers(size_t e);
+
+    // Receive buffer of empty messages
+    double dummy_recv_buffer_[1];
+
+    // Ranks of the neighbors to the left and to the right among the
+    // processes of this node, MPI_UNDEFINED if they live on other nodes
+    Eigen::Array3i node_left_, node_right_;
+    // Segments for the ghost positions sent to neighbors on the same node,
+    // shared with copies of this domain. Every exchange has two slots per
+    // neighbor, which are used in turns by consecutive calls to
+    // `update_ghost_positions`, such that a slot is only written again
+    // after the neighbor has answered with a message sent after reading it.
+    std::shared_ptr<MPI::SharedWindow> ghost_window_;
+    // Doubles of the shared segment used by the exchanges and the slot used
+    // by the next call
+    Eigen::Index ghost_segment_size_ = 0;
+    int ghost_slot_ = 0;
+    // Offsets of the positions of every exchange in the send and receive
+    // buffers of `position_update_`
+    std::vector<Eigen::Index> position_send_offsets_, position_recv_offsets_;
 };
 
 
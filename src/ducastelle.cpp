@@ -24,110 +24,344 @@
 
 #include <iostream>
 
+#include "arena.h"
 #include "ducastelle.h"
 
+template <typename Real> using RealPositions_t = Eigen::Array<Real, 3, Eigen::Dynamic>;
+template <typename Real> using RealRow_t = Eigen::Array<Real, 1, Eigen::Dynamic>;
+
 /*
- * This is the embedded atom method potential described in
- *     Ducastelle, "Modules élastiques des métaux de transition", J. Phys. 31,
- * 1055 (1970) Gupta, "Lattice relaxation at a metal surface", Phys. Rev. B 23,
- * 6265 (1981) Cleri, Rosato, "Tight-binding potentials for transition metals
- * and alloys", Phys. Rev. B 48, 22 (1993) The default values for the parameters
- * are the Au parameters from Cleri & Rosato's paper.
+ * Convert positions to single precision. Coordinates are taken relative to the
+ * lower corner of the bounding box (the origin of the neighbor list grid) so
+ * that they stay small and distances between neighbors keep their resolution.
+ * The converted positions live in the step arena.
  */
-Eigen::ArrayXd _ducastelle(Atoms &atoms, const NeighborList &neighbor_list,
-                  double cutoff, double A, double xi, double p, double q,
-                  double re) {
-    auto cutoff_sq{cutoff * cutoff};
-    double xi_sq{xi * xi};
+static Eigen::Map<RealPositions_t<float>, Eigen::Aligned64> relative_positions(const Vectors_t &positions) {
+    Eigen::Array3d origin{positions.rowwise().minCoeff()};
+    auto relative{step_arena().map<RealPositions_t<float>>(3, positions.cols())};
+    relative = (positions.colwise() - origin).cast<float>();
+    return relative;
+}
 
-    // Reset energies and forces. This needs to be turned off if multiple
-    // potentials are present.
-    atoms.forces.setZero();
+/*
+ * Largest number of neighbors of any atom, used to size the per-atom gather
+ * buffers once per call.
+ */
+static Eigen::Index max_nb_neighbors(const NeighborIndices_t &seed) {
+    auto nb_atoms{seed.size() - 1};
+    if (nb_atoms <= 0)
+        return 0;
+    return (seed.tail(nb_atoms) - seed.head(nb_atoms)).maxCoeff();
+}
 
-    // compute embedding energies
-    Eigen::ArrayXd embedding(
-        atoms.nb_atoms()); // contains first density, later energy
-    embedding.setZero();
-    for (auto [i, j] : neighbor_list) {
-        if (i < j) {
-            Eigen::Vector3d distance_vector{atoms.positions.col(i) -
-                                            atoms.positions.col(j)};
-            auto distance_sq = distance_vector.squaredNorm();
-            if (distance_sq < cutoff_sq) {
-                double density_contribution{
-                    xi_sq *
-                    std::exp(-2 * q * (std::sqrt(distance_sq) / re - 1.0))};
-                embedding(i) += density_contribution;
-                embedding(j) += density_contribution;
-            }
+/*
+ * Compute the embedding density of the atoms `indices`, the densities of the
+ * remaining atoms are left untouched. The neighbor list contains each pair
+ * twice, which allows to compute the density of each atom from its own
+ * neighbors without scattering into the neighbors. The inner loop is a gather
+ * over the neighbors of atom i that Eigen vectorizes; the kernel runs in the
+ * precision of the positions `r`, the densities are summed in double
+ * precision. Since every atom only writes its own density, threads share the
+ * atoms without synchronization.
+ */
+template <typename Real, typename Positions, typename Indices>
+static void _embedding_density(const Positions &r,
+                               const NeighborList &neighbor_list,
+                               const Indices &indices, Eigen::Ref<Eigen::ArrayXd> density,
+                               double cutoff, double xi, double q, double re) {
+    auto [seed, neighbors]{neighbor_list.neighbors()};
+    const Real cutoff_sq(cutoff * cutoff), two_q(2 * q), re_(re);
+    const double xi_sq{xi * xi};
+
+    auto nb_neighbors{max_nb_neighbors(seed)};
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        // every thread gathers into buffers of its own arena
+        Arena &arena{step_arena()};
+        Arena::Scope scope{arena};
+        auto distance_vectors{arena.map<RealPositions_t<Real>>(3, nb_neighbors)};
+        auto distances_sq{arena.map<RealRow_t<Real>>(distance_vectors.cols())};
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for (Eigen::Index k = 0; k < indices.size(); ++k) {
+            Eigen::Index i{indices(k)};
+            auto n{seed(i + 1) - seed(i)};
+            auto &&j{neighbors.segment(seed(i), n)};
+            distance_vectors.leftCols(n) = r(Eigen::all, j).colwise() - r.col(i);
+            distances_sq.head(n) = distance_vectors.leftCols(n).colwise().squaredNorm();
+            density(i) = (distances_sq.head(n) < cutoff_sq)
+                             .select((-two_q * (distances_sq.head(n).sqrt() / re_ - 1)).exp(), Real(0))
+                             .template cast<double>()
+                             .sum() *
+                         xi_sq;
         }
     }
+}
 
-    // compute embedding contribution to the potential energy
-    embedding = -embedding.sqrt();
-
-    // per-atom energies
-    Eigen::ArrayXd energies{embedding};
-
-    // compute forces
-    for (auto [i, j] : neighbor_list) {
-        if (i < j) {
-            double d_embedding_density_i{0};
-            // this is the derivative of sqrt(embedding)
-            if (embedding(i) != 0)
-                d_embedding_density_i = 1 / (2 * embedding(i));
-
-            Eigen::Vector3d distance_vector{atoms.positions.col(i) -
-                                            atoms.positions.col(j)};
-            auto distance_sq = distance_vector.squaredNorm();
-            if (distance_sq < cutoff_sq) {
-                double distance{std::sqrt(distance_sq)};
-                double d_embedding_density_j{0};
-                // this is the derivative of sqrt(embedding)
-                if (embedding(j) != 0)
-                    d_embedding_density_j = 1 / (2 * embedding(j));
-
-                // repulsive energy and derivative of it with respect to
-                // distance
-                double repulsive_energy{2 * A *
-                                        std::exp(-p * (distance / re - 1.0))};
-                double d_repulsive_energy{-repulsive_energy * p / re};
-
-                // derivative of embedding energy contributions
-                double fac{-2 * q / re * xi_sq *
-                           std::exp(-2 * q * (distance / re - 1.0))};
-
-                // pair force
-                Eigen::Array3d pair_force{
-                    (d_repulsive_energy +
-                     fac * (d_embedding_density_i + d_embedding_density_j)) *
-                    distance_vector.normalized()};
-
-                // sum per-atom energies
-                repulsive_energy *= 0.5;
-                energies(i) += repulsive_energy;
-                energies(j) += repulsive_energy;
-
-                // sum per-atom forces
-                atoms.forces.col(i) -= pair_force;
-                atoms.forces.col(j) += pair_force;
-            }
+/*
+ * Derivatives of the embedding energy -sqrt(density) of the atoms `indices`,
+ * zero for isolated atoms.
+ */
+template <typename Indices>
+static void _embedding_derivatives(const Eigen::Ref<const Eigen::ArrayXd> &density, const Indices &indices,
+                                   Eigen::Ref<Eigen::ArrayXd> d_embedding) {
+    for (Eigen::Index k = 0; k < indices.size(); ++k) {
+        Eigen::Index i{indices(k)};
+        d_embedding(i) = density(i) > 0 ? -0.5 / std::sqrt(density(i)) : 0.0;
+    }
+}
+
+/*
+ * Compute forces on the atoms `indices` from the embedding densities and the
+ * derivatives of the embedding energies of these atoms and their neighbors,
+ * and return the potential energy of those among the first nb_local atoms
+ * (zero if no energy is requested). Forces on other atoms are left untouched.
+ * As for the density, threads share the atoms.
+ */
+template <typename Real, typename Positions, typename Indices>
+static double _ducastelle_forces(Atoms &atoms, const Positions &r,
+                                 const NeighborList &neighbor_list,
+                                 const Eigen::Ref<const Eigen::ArrayXd> &density,
+                                 const Eigen::Ref<const Eigen::ArrayXd> &d_embedding, int nb_local,
+                                 const Indices &indices, const PotentialOptions &options,
+                                 double cutoff, double A, double xi, double p, double q,
+                                 double re) {
+    auto [seed, neighbors]{neighbor_list.neighbors()};
+    const Real cutoff_(cutoff), two_A(2 * A), p_(p), two_q(2 * q), re_(re),
+        xi_sq(xi * xi);
+    const bool repulsive{options.terms != ForceTerms::Embedding}, embedding{options.terms != ForceTerms::Repulsive};
+
+    auto nb_neighbors{max_nb_neighbors(seed)};
+
+    double epot{0};
+#ifdef _OPENMP
+#pragma omp parallel reduction(+ : epot)
+#endif
+    {
+        // every thread gathers into buffers of its own arena
+        Arena &arena{step_arena()};
+        Arena::Scope scope{arena};
+        auto distance_vectors{arena.map<RealPositions_t<Real>>(3, nb_neighbors)};
+        auto distances{arena.map<RealRow_t<Real>>(distance_vectors.cols())},
+            repulsive_energies{arena.map<RealRow_t<Real>>(distance_vectors.cols())},
+            pair_forces{arena.map<RealRow_t<Real>>(distance_vectors.cols())};
+        repulsive_energies.setZero();
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for (Eigen::Index k = 0; k < indices.size(); ++k) {
+            Eigen::Index i{indices(k)};
+            auto n{seed(i + 1) - seed(i)};
+            auto &&j{neighbors.segment(seed(i), n)};
+            distance_vectors.leftCols(n) = r(Eigen::all, j).colwise() - r.col(i);
+            distances.head(n) = distance_vectors.leftCols(n).colwise().norm();
+            auto &&inside{distances.head(n) < cutoff_};
+
+            // repulsive pair energy and its derivative with respect to distance
+            if (repulsive)
+                repulsive_energies.head(n) =
+                    inside.select(two_A * (-p_ * (distances.head(n) / re_ - 1)).exp(), Real(0));
+            pair_forces.head(n) = -p_ / re_ * repulsive_energies.head(n);
+
+            // derivative of the density contributions with respect to distance,
+            // weighted by the embedding derivatives of both atoms
+            if (embedding)
+                pair_forces.head(n) +=
+                    inside.select(-two_q / re_ * xi_sq * (-two_q * (distances.head(n) / re_ - 1)).exp(), Real(0)) *
+                    (Real(d_embedding(i)) + d_embedding(j).transpose().template cast<Real>());
+
+            // divide by the distance to project onto the distance vector
+            pair_forces.head(n) /= distances.head(n);
+
+            // sum per-atom forces
+            atoms.forces.col(i) = (distance_vectors.leftCols(n).rowwise() * pair_forces.head(n))
+                                      .template cast<double>()
+                                      .rowwise()
+                                      .sum();
+
+            // per-atom energy: embedding energy plus half of the pair energies
+            if (options.energy && i < nb_local)
+                epot += (embedding ? -std::sqrt(density(i)) : 0) +
+                        0.5 * repulsive_energies.head(n).template cast<double>().sum();
         }
     }
 
     // Return total potential energy
-    return energies;
+    return epot;
+}
+
+/*
+ * Indices of the atoms that get forces: the first nb_local atoms, or all atoms
+ * if ghost forces are requested. Forces are reset, those on the remaining
+ * atoms stay zero. (This needs to be turned off if multiple potentials are
+ * present.)
+ */
+static auto all_forces(Atoms &atoms, int nb_local, const PotentialOptions &options) {
+    atoms.forces.setZero();
+    Eigen::Index nb_forces{options.ghost_forces ? Eigen::Index(atoms.nb_atoms()) : nb_local};
+    return Eigen::ArrayXi::LinSpaced(nb_forces, 0, nb_forces - 1);
+}
+
+template <typename Real, typename Positions>
+static double _ducastelle(Atoms &atoms, const Positions &r,
+                          const NeighborList &neighbor_list, int nb_local,
+                          const PotentialOptions &options, double cutoff,
+                          double A, double xi, double p, double q, double re) {
+    // densities of ghost atoms are needed for the forces on local atoms, the
+    // repulsion alone does not need them
+    auto density{step_arena().map<Eigen::ArrayXd>(r.cols())};
+    auto d_embedding{step_arena().map<Eigen::ArrayXd>(r.cols())};
+    density.setZero();
+    d_embedding.setZero();
+    if (options.terms != ForceTerms::Repulsive) {
+        auto all{Eigen::ArrayXi::LinSpaced(r.cols(), 0, r.cols() - 1)};
+        _embedding_density<Real>(r, neighbor_list, all, density, cutoff, xi, q, re);
+        _embedding_derivatives(density, all, d_embedding);
+    }
+    return _ducastelle_forces<Real>(atoms, r, neighbor_list, density, d_embedding, nb_local,
+                                    all_forces(atoms, nb_local, options), options, cutoff, A, xi, p, q, re);
+}
+
+double ducastelle(Atoms &atoms, const NeighborList &neighbor_list, int nb_local,
+                  const PotentialOptions &options, double cutoff, double A,
+                  double xi, double p, double q, double re) {
+    if (atoms.nb_atoms() == 0)
+        return 0;
+    assert(std::get<0>(neighbor_list.neighbors()).size() == atoms.nb_atoms() + 1);
+
+    Arena::Scope scope{step_arena()};
+    if (options.precision == Precision::Mixed) {
+        return _ducastelle<float>(atoms, relative_positions(atoms.positions), neighbor_list, nb_local, options,
+                                  cutoff, A, xi, p, q, re);
+    }
+    return _ducastelle<double>(atoms, atoms.positions, neighbor_list, nb_local, options, cutoff, A, xi, p, q, re);
+}
+
+void ducastelle_density(const Atoms &atoms, const NeighborList &neighbor_list, int nb_local,
+                        const PotentialOptions &options, Eigen::Ref<Eigen::ArrayXd> density, double cutoff,
+                        double /* A */, double xi, double /* p */, double q, double re) {
+    assert(density.size() == atoms.nb_atoms());
+    if (atoms.nb_atoms() == 0)
+        return;
+    assert(std::get<0>(neighbor_list.neighbors()).size() == atoms.nb_atoms() + 1);
+
+    Arena::Scope scope{step_arena()};
+    density.setZero();
+    auto local{Eigen::ArrayXi::LinSpaced(nb_local, 0, nb_local - 1)};
+    if (options.precision == Precision::Mixed) {
+        _embedding_density<float>(relative_positions(atoms.positions), neighbor_list, local, density, cutoff, xi, q,
+                                  re);
+    } else {
+        _embedding_density<double>(atoms.positions, neighbor_list, local, density, cutoff, xi, q, re);
+    }
+}
+
+Eigen::ArrayXd ducastelle_density(const Atoms &atoms, const NeighborList &neighbor_list, int nb_local,
+                                  const PotentialOptions &options, double cutoff, double A, double xi,
+                                  double p, double q, double re) {
+    Eigen::ArrayXd density(atoms.nb_atoms());
+    ducastelle_density(atoms, neighbor_list, nb_local, options, density, cutoff, A, xi, p, q, re);
+    return density;
+}
+
+double ducastelle_forces(Atoms &atoms, const NeighborList &neighbor_list,
+                         const Eigen::Ref<const Eigen::ArrayXd> &density, int nb_local,
+                         const PotentialOptions &options, double cutoff, double A, double xi, double p, double q,
+                         double re) {
+    if (atoms.nb_atoms() == 0)
+        return 0;
+    assert(density.size() == atoms.nb_atoms());
+
+    Arena::Scope scope{step_arena()};
+    auto d_embedding{step_arena().map<Eigen::ArrayXd>(density.size())};
+    _embedding_derivatives(density, Eigen::ArrayXi::LinSpaced(density.size(), 0, density.size() - 1), d_embedding);
+    auto indices{all_forces(atoms, nb_local, options)};
+    if (options.precision == Precision::Mixed) {
+        return _ducastelle_forces<float>(atoms, relative_positions(atoms.positions), neighbor_list, density,
+                                         d_embedding, nb_local, indices, options, cutoff, A, xi, p, q, re);
+    }
+    return _ducastelle_forces<double>(atoms, atoms.positions, neighbor_list, density, d_embedding, nb_local, indices,
+                                      options, cutoff, A, xi, p, q, re);
+}
+
+DucastellePhases::DucastellePhases(Atoms &atoms, const NeighborList &neighbor_list, int nb_local,
+                                   const PotentialOptions &options, double cutoff, double A, double xi, double p,
+                                   double q, double re)
+    : atoms_(atoms),
+      neighbor_list_(neighbor_list),
+      nb_local_(nb_local),
+      options_(options),
+      cutoff_(cutoff),
+      A_(A),
+      xi_(xi),
+      p_(p),
+      q_(q),
+      re_(re),
+      origin_(Eigen::Array3d::Zero()),
+      positions_(step_arena().map<Eigen::Array3Xf>(3, options.precision == Precision::Mixed ? atoms.nb_atoms() : 0)),
+      density_(step_arena().map<Eigen::ArrayXd>(atoms.nb_atoms())),
+      d_embedding_(step_arena().map<Eigen::ArrayXd>(atoms.nb_atoms())) {
+    assert(atoms.nb_atoms() == 0 || std::get<0>(neighbor_list.neighbors()).size() == atoms.nb_atoms() + 1);
+    density_.setZero();
+    d_embedding_.setZero();
+    // only the positions of local atoms are current yet
+    if (positions_.cols() > 0 && nb_local_ > 0) {
+        origin_ = atoms.positions.leftCols(nb_local_).rowwise().minCoeff();
+        positions_.leftCols(nb_local_) = (atoms.positions.leftCols(nb_local_).colwise() - origin_).cast<float>();
+    }
+}
+
+void DucastellePhases::density(const Eigen::Ref<const Eigen::ArrayXi> &indices) {
+    if (options_.terms == ForceTerms::Repulsive)
+        return;
+    if (options_.precision == Precision::Mixed) {
+        _embedding_density<float>(positions_, neighbor_list_, indices, density_, cutoff_, xi_, q_, re_);
+    } else {
+        _embedding_density<double>(atoms_.positions, neighbor_list_, indices, density_, cutoff_, xi_, q_, re_);
+    }
+    _embedding_derivatives(density_, indices, d_embedding_);
+}
+
+void DucastellePhases::ghost_positions() {
+    if (positions_.cols() > nb_local_) {
+        auto nb_ghosts{positions_.cols() - nb_local_};
+        positions_.rightCols(nb_ghosts) = (atoms_.positions.rightCols(nb_ghosts).colwise() - origin_).cast<float>();
+    }
+}
+
+void DucastellePhases::ghost_densities() {
+    Eigen::Index nb_ghosts{density_.size() - nb_local_};
+    _embedding_derivatives(density_, Eigen::ArrayXi::LinSpaced(nb_ghosts, nb_local_, density_.size() - 1),
+                           d_embedding_);
+}
+
+double DucastellePhases::forces(const Eigen::Ref<const Eigen::ArrayXi> &indices) {
+    if (indices.size() == 0)
+        return 0;
+    if (options_.precision == Precision::Mixed) {
+        return _ducastelle_forces<float>(atoms_, positions_, neighbor_list_, density_, d_embedding_, nb_local_,
+                                         indices, options_, cutoff_, A_, xi_, p_, q_, re_);
+    }
+    return _ducastelle_forces<double>(atoms_, atoms_.positions, neighbor_list_, density_, d_embedding_, nb_local_,
+                                      indices, options_, cutoff_, A_, xi_, p_, q_, re_);
 }
 
 double ducastelle(Atoms &atoms, const NeighborList &neighbor_list,
                   double cutoff, double A, double xi, double p, double q,
                   double re) {
-    return _ducastelle(atoms, neighbor_list, cutoff, A, xi, p, q, re).sum();
+    return ducastelle(atoms, neighbor_list, atoms.nb_atoms(), PotentialOptions{}, cutoff, A, xi, p, q, re);
 }
 
 double ducastelle(Atoms &atoms, const NeighborList &neighbor_list, int nb_local,
                   double cutoff, double A, double xi, double p, double q,
                   double re) {
-    auto energies = _ducastelle(atoms, neighbor_list, cutoff, A, xi, p, q, re);
-    return energies(Eigen::seq(0, nb_local - 1)).sum();
+    PotentialOptions options;
+    options.ghost_forces = true;
+    return ducastelle(atoms, neighbor_list, nb_local, options, cutoff, A, xi, p, q, re);
 }
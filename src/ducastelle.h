@@ -27,6 +27,7 @@
 
 #include "atoms.h"
 #include "neighbors.h"
+#include "potential.h"
 
 /*
  * This is the embedded atom method potential described in
@@ -40,5 +41,88 @@ double ducastelle(Atoms &atoms, const NeighborList &neighbor_list, double cutoff
 // version that excludes ghost atoms
 double ducastelle(Atoms &atoms, const NeighborList &neighbor_list, int nb_local, double cutoff = 10.0, double A = 0.2061,
                   double xi = 1.790, double p = 10.229, double q = 4.036, double re = 4.079 / sqrt(2));
+// version that excludes ghost atoms and takes evaluation options, e.g. mixed precision
+double ducastelle(Atoms &atoms, const NeighborList &neighbor_list, int nb_local, const PotentialOptions &options,
+                  double cutoff = 10.0, double A = 0.2061, double xi = 1.790, double p = 10.229, double q = 4.036,
+                  double re = 4.079 / sqrt(2));
+
+/*
+ * The same potential split into two phases around the communication of ghost
+ * atoms. The first phase returns the embedding densities of the first nb_local
+ * atoms (the entries of ghost atoms are zero). After the densities of ghost
+ * atoms have been filled in by their owners, e.g. with
+ * `Domain::update_ghost_values`, the second phase computes forces and returns
+ * the potential energy of the first nb_local atoms. With this split, the ghost
+ * shell only needs to be one cutoff wide.
+ */
+Eigen::ArrayXd ducastelle_density(const Atoms &atoms, const NeighborList &neighbor_list, int nb_local,
+                                  const PotentialOptions &options, double cutoff = 10.0, double A = 0.2061,
+                                  double xi = 1.790, double p = 10.229, double q = 4.036,
+                                  double re = 4.079 / sqrt(2));
+// version that writes the densities into an existing array, e.g. one from the
+// step arena
+void ducastelle_density(const Atoms &atoms, const NeighborList &neighbor_list, int nb_local,
+                        const PotentialOptions &options, Eigen::Ref<Eigen::ArrayXd> density, double cutoff = 10.0,
+                        double A = 0.2061, double xi = 1.790, double p = 10.229, double q = 4.036,
+                        double re = 4.079 / sqrt(2));
+double ducastelle_forces(Atoms &atoms, const NeighborList &neighbor_list,
+                         const Eigen::Ref<const Eigen::ArrayXd> &density, int nb_local,
+                         const PotentialOptions &options, double cutoff = 10.0, double A = 0.2061,
+                         double xi = 1.790, double p = 10.229, double q = 4.036, double re = 4.079 / sqrt(2));
+
+/*
+ * The potential split into phases around the communication of ghost atoms,
+ * for callers that overlap it with work on local atoms (see
+ * add_domain_stages and NeighborList::split):
+ *     DucastellePhases eam(atoms, neighbor_list, nb_local, options, cutoff);
+ *     eam.density(interior);       // ghost positions may be in flight
+ *     eam.ghost_positions();       // once they have arrived
+ *     eam.density(boundary);       // local atoms among them
+ *     domain.begin_update_ghost_values(densities);
+ *     eam.forces(interior);
+ *     domain.finish_update_ghost_values(densities);
+ *     eam.ghost_densities();
+ *     eam.forces(boundary);
+ * In mixed precision the positions are converted once, those of ghosts only
+ * after they arrived. The derivatives of the embedding energies are computed
+ * once per atom: for local atoms together with their densities, for ghosts
+ * after their densities arrived, so entries of ghosts are never accessed
+ * while they are being received. All arrays live in the step arena, an
+ * instance must not outlive the enclosing Arena::Scope.
+ */
+class DucastellePhases {
+  private:
+    Atoms &atoms_;
+    const NeighborList &neighbor_list_;
+    int nb_local_;
+    PotentialOptions options_;
+    double cutoff_, A_, xi_, p_, q_, re_;
+    // in mixed precision, positions relative to the lower corner of the
+    // local atoms
+    Eigen::Array3d origin_;
+    Eigen::Map<Eigen::Array3Xf, Eigen::Aligned64> positions_;
+    // embedding densities and derivatives of the embedding energies
+    Eigen::Map<Eigen::ArrayXd, Eigen::Aligned64> density_, d_embedding_;
+
+  public:
+    DucastellePhases(Atoms &atoms, const NeighborList &neighbor_list, int nb_local, const PotentialOptions &options,
+                     double cutoff = 10.0, double A = 0.2061, double xi = 1.790, double p = 10.229,
+                     double q = 4.036, double re = 4.079 / sqrt(2));
+
+    // embedding densities of the local atoms `indices`, whose neighbors
+    // need to have their current positions
+    void density(const Eigen::Ref<const Eigen::ArrayXi> &indices);
+    // positions of the ghosts have been updated
+    void ghost_positions();
+    // embedding densities of the ghosts have been filled in
+    void ghost_densities();
+    // forces on the atoms `indices`, returns the potential energy of those
+    // among the first nb_local
+    double forces(const Eigen::Ref<const Eigen::ArrayXi> &indices);
+
+    // embedding densities of all atoms, those of ghosts are zero until they
+    // are filled in
+    Eigen::Map<Eigen::ArrayXd, Eigen::Aligned64> &densities() { return density_; }
+};
 
 #endif //YAMD_GUPTA_H
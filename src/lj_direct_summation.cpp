@@ -1,4 +1,6 @@
+#include "arena.h"
 #include "lj_direct_summation.h"
+#include <cassert>
 #include <cmath>
 #include <Eigen/Dense>
 
@@ -29,17 +31,58 @@ double lj_direct_summation(Atoms &atoms, double epsilon, double sigma) {
     return epot / 2;
 }
 
-double lj_direct_summation(Atoms &atoms, NeighborList &neighbor_list, double cutoff, double epsilon, double sigma) {
-    double epot = 0;
-    neighbor_list.update(atoms, cutoff);
-    atoms.forces.setZero();
+// Per-atom gather kernel over the (full) neighbor list. Pair geometry is
+// evaluated in the precision of `r`, forces and energies are summed in double.
+template <typename Real, typename Positions>
+static double _lj_neighbors(Atoms &atoms, const Positions &r,
+                            const NeighborList &neighbor_list, double cutoff, double epsilon, double sigma,
+                            bool energy) {
+    auto [seed, neighbors]{neighbor_list.neighbors()};
+    const Real four_epsilon(4 * epsilon), sigma_sq(sigma * sigma), cutoff_sq(cutoff * cutoff);
     double energy_shift = w(cutoff, epsilon, sigma);
-    for (auto [k, i] : neighbor_list) {
-        Eigen::Vector3d r_ik_vec = atoms.positions.col(i) - atoms.positions.col(k);
-        double r_ik = r_ik_vec.norm();
-        Eigen::Vector3d f_k = atoms.forces.col(k); // workaround because '+=' is not supported
-        atoms.forces.col(k) = f_k + dw_dr(r_ik, epsilon, sigma) * r_ik_vec.normalized();
-        epot += w(r_ik, epsilon, sigma) - energy_shift;
+
+    Eigen::Index max_neighbors{(seed.tail(r.cols()) - seed.head(r.cols())).maxCoeff()};
+    Arena &arena{step_arena()};
+    auto distance_vectors{arena.map<Eigen::Array<Real, 3, Eigen::Dynamic>>(3, max_neighbors)};
+    auto sr6{arena.map<Eigen::Array<Real, 1, Eigen::Dynamic>>(max_neighbors)},
+        pair_forces{arena.map<Eigen::Array<Real, 1, Eigen::Dynamic>>(max_neighbors)};
+
+    double epot = 0;
+    for (Eigen::Index k = 0; k < r.cols(); k++) {
+        auto n{seed(k + 1) - seed(k)};
+        auto &&i{neighbors.segment(seed(k), n)};
+        distance_vectors.leftCols(n) = r(Eigen::all, i).colwise() - r.col(k);
+        auto &&r_sq{distance_vectors.leftCols(n).colwise().squaredNorm()};
+        // the neighbor list may contain pairs beyond the cutoff (skin)
+        auto &&inside{r_sq <= cutoff_sq};
+        sr6.head(n) = inside.select((sigma_sq / r_sq).cube(), Real(0));
+        // dw_dr(r) / r, projects the force onto the distance vector
+        pair_forces.head(n) = four_epsilon * (Real(6) * sr6.head(n) - Real(12) * sr6.head(n).square()) / r_sq;
+        atoms.forces.col(k) =
+            (distance_vectors.leftCols(n).rowwise() * pair_forces.head(n)).template cast<double>().rowwise().sum();
+        if (energy)
+            epot += (four_epsilon * (sr6.head(n).square() - sr6.head(n))).template cast<double>().sum() -
+                    inside.count() * energy_shift;
     }
     return epot / 2;
 }
+
+double lj_direct_summation(Atoms &atoms, NeighborList &neighbor_list, double cutoff, double epsilon, double sigma,
+                           const PotentialOptions &options) {
+    assert(options.terms == ForceTerms::All);
+    neighbor_list.update(atoms, cutoff);
+    if (atoms.nb_atoms() == 0)
+        return 0;
+    Arena::Scope scope{step_arena()};
+    if (options.precision == Precision::Mixed) {
+        Eigen::Array3d origin{atoms.positions.rowwise().minCoeff()};
+        auto r{step_arena().map<Eigen::Array3Xf>(3, atoms.nb_atoms())};
+        r = (atoms.positions.colwise() - origin).cast<float>();
+        return _lj_neighbors<float>(atoms, r, neighbor_list, cutoff, epsilon, sigma, options.energy);
+    }
+    return _lj_neighbors<double>(atoms, atoms.positions, neighbor_list, cutoff, epsilon, sigma, options.energy);
+}
+
+double lj_direct_summation(Atoms &atoms, NeighborList &neighbor_list, double cutoff, double epsilon, double sigma) {
+    return lj_direct_summation(atoms, neighbor_list, cutoff, epsilon, sigma, PotentialOptions{});
+}
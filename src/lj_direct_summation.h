@@ -3,6 +3,7 @@
 
 #include "atoms.h"
 #include "neighbors.h"
+#include "potential.h"
 
 // Force computation with Lennard-Jones potential (https://en.wikipedia.org/wiki/Lennard-Jones_potential). 
 // Returns the potential energy of the system.
@@ -12,5 +13,11 @@ double lj_direct_summation(Atoms &atoms, double epsilon, double sigma);
 // Returns the potential energy of the system.
 double lj_direct_summation(Atoms &atoms, NeighborList &neighbor_list, double cutoff, double epsilon, double sigma);
 
+// Force computation with Lennard-Jones potential (https://en.wikipedia.org/wiki/Lennard-Jones_potential),
+// with evaluation options, e.g. mixed precision. The potential has no split into force terms, `options.terms`
+// has to be ForceTerms::All. Returns the potential energy of the system.
+double lj_direct_summation(Atoms &atoms, NeighborList &neighbor_list, double cutoff, double epsilon, double sigma,
+                           const PotentialOptions &options);
+
 
 #endif  // __LJ_DIRECT_SUMMATION_H
@@ -0,0 +1,51 @@
+#include "minimizer.h"
+#include "verlet.h"
+#include <limits>
+
+// power of the forces, squared norm of forces and velocities and the largest
+// force of the first nb_local atoms
+static std::tuple<Eigen::Array3d, double> force_stats(const Atoms &atoms, int nb_local,
+                                                      const MinimizerReductions &reductions) {
+    auto &&f{atoms.forces.leftCols(nb_local)};
+    auto &&v{atoms.velocities.leftCols(nb_local)};
+    Eigen::Array3d sums{(f * v).sum(), f.square().sum(), v.square().sum()};
+    double fmax_sq{nb_local > 0 ? f.colwise().squaredNorm().maxCoeff() : 0};
+    return {reductions.sum(sums), std::sqrt(reductions.max(fmax_sq))};
+}
+
+MinimizerResult fire_minimize(Atoms &atoms, const std::function<int(double)> &compute_forces,
+                              const FireParameters &parameters, const MinimizerReductions &reductions) {
+    double timestep{parameters.timestep};
+    double alpha{parameters.alpha};
+    size_t nb_downhill{0};
+
+    atoms.velocities.setZero();
+    int nb_local{compute_forces(std::numeric_limits<double>::infinity())};
+    auto [sums, fmax]{force_stats(atoms, nb_local, reductions)};
+    size_t step{0};
+    for (; step < parameters.max_steps && fmax > parameters.fmax; step++) {
+        double power{sums(0)}, f_sq{sums(1)}, v_sq{sums(2)};
+        if (power > 0) {
+            // steer the velocities towards the forces
+            if (f_sq > 0)
+                atoms.velocities = (1 - alpha) * atoms.velocities + alpha * std::sqrt(v_sq / f_sq) * atoms.forces;
+            if (++nb_downhill > parameters.min_steps) {
+                timestep = std::min(timestep * parameters.increase, parameters.max_timestep);
+                alpha *= parameters.alpha_decrease;
+            }
+        } else {
+            // moving uphill: stop and restart carefully
+            atoms.velocities.setZero();
+            timestep *= parameters.decrease;
+            alpha = parameters.alpha;
+            nb_downhill = 0;
+        }
+
+        nb_local = compute_forces(verlet_step1(atoms, timestep));
+        verlet_step2(atoms, timestep);
+        std::tie(sums, fmax) = force_stats(atoms, nb_local, reductions);
+    }
+
+    atoms.velocities.setZero();
+    return {fmax <= parameters.fmax, step, fmax};
+}
@@ -0,0 +1,47 @@
+#ifndef __MINIMIZER_H
+#define __MINIMIZER_H
+
+#include "atoms.h"
+#include <Eigen/Dense>
+#include <functional>
+
+// Parameters of the FIRE minimizer, the defaults are the ones proposed by
+// Bitzek et al. The timesteps are in the same units as the integrator's.
+struct FireParameters {
+    double fmax = 1e-2;        // converged once no force is larger (eV/Å)
+    size_t max_steps = 10000;  // give up after this many steps
+    double timestep = 1.0;     // initial timestep
+    double max_timestep = 10.0;
+    size_t min_steps = 5;      // steps downhill before the timestep grows
+    double increase = 1.1;
+    double decrease = 0.5;
+    double alpha = 0.1;        // initial mixing of velocities and forces
+    double alpha_decrease = 0.99;
+};
+
+// Reductions over all domains of a decomposed system, the defaults are for a
+// single process.
+struct MinimizerReductions {
+    std::function<Eigen::Array3d(const Eigen::Array3d &)> sum = [](const Eigen::Array3d &x) { return x; };
+    std::function<double(double)> max = [](double x) { return x; };
+};
+
+struct MinimizerResult {
+    bool converged;
+    size_t nb_steps;
+    double fmax;  // largest force at the end
+};
+
+// Relax the atoms into the nearest local minimum of the potential energy with
+// the fast inertial relaxation engine (FIRE) of Bitzek et al., Phys. Rev. Lett.
+// 97, 170201 (2006). `compute_forces(max_displacement)` is called after the
+// atoms moved by at most `max_displacement` (infinite for the initial call)
+// and computes the forces into `atoms.forces`, e.g. updating the neighbor list
+// and ghost atoms on the way. It returns the number of local atoms, only these
+// take part in the convergence test and the reductions. The velocities are
+// zero on return.
+MinimizerResult fire_minimize(Atoms &atoms, const std::function<int(double)> &compute_forces,
+                              const FireParameters &parameters = FireParameters{},
+                              const MinimizerReductions &reductions = MinimizerReductions{});
+
+#endif // __MINIMIZER_H
@@ -29,6 +29,11 @@
 
 #include <Eigen/Dense>
 
+#include <algorithm>
+#include <vector>
+
+#include "arena.h"
+
 /*
  * Wrap integer value to interval [0..range-1]. This is the modulo operation.
  */
@@ -49,9 +54,13 @@ template <typename T> inline T wrap_to_distance(T value, T range) {
 }
 
 namespace MPI {
-// Ensure finalize is always called
+// Ensure finalize is always called. Threads may run within each process as
+// long as only the main thread calls MPI (MPI_THREAD_FUNNELED).
 struct init_guard {
-    init_guard(int *argc, char ***argv) { MPI_Init(argc, argv); }
+    // thread support granted by the MPI library
+    int provided;
+
+    init_guard(int *argc, char ***argv) { MPI_Init_thread(argc, argv, MPI_THREAD_FUNNELED, &provided); }
     init_guard() : init_guard(nullptr, nullptr) {}
     ~init_guard() { MPI_Finalize(); }
 };
@@ -158,44 +167,127 @@ template <typename T> T allreduce(T sendval, MPI_Op op, MPI_Comm comm) {
     return recvval;
 }
 
+/*
+ * Memory that the processes of a node access directly: every process owns a
+ * segment of doubles of a window allocated with MPI_Win_allocate_shared and
+ * reaches the segments of all others through plain pointers. The window
+ * stays in a passive target epoch, so accesses are ordered with `sync` and
+ * any message between the processes involved: the writer syncs and then
+ * sends, the reader receives and then syncs.
+ */
+class SharedWindow {
+  private:
+    // processes of the node, owned by the window
+    MPI_Comm comm_;
+    MPI_Win win_ = MPI_WIN_NULL;
+    // doubles in the segment of this process
+    size_t capacity_ = 0;
+    // segments of all processes of the node
+    std::vector<double *> segments_;
+
+    void free() {
+        if (win_ != MPI_WIN_NULL) {
+            MPI_Win_unlock_all(win_);
+            MPI_Win_free(&win_);
+        }
+    }
+
+  public:
+    explicit SharedWindow(MPI_Comm comm) : comm_(comm), segments_(comm_size(comm), nullptr) {}
+    SharedWindow(const SharedWindow &) = delete;
+    SharedWindow &operator=(const SharedWindow &) = delete;
+    ~SharedWindow() {
+        free();
+        MPI_Comm_free(&comm_);
+    }
+
+    MPI_Comm communicator() const { return comm_; }
+
+    /*
+     * Make the segment of this process hold at least `size` doubles.
+     * Collective over the node: if any segment is too small, the window is
+     * allocated anew with room to grow and the contents are lost.
+     */
+    void reserve(size_t size) {
+        if (allreduce(int(size > capacity_), MPI_MAX, comm_) == 0) {
+            return;
+        }
+        free();
+        capacity_ = std::max(capacity_, 2 * size);
+        // segments on the memory of their owners rather than one block
+        MPI_Info info;
+        MPI_Info_create(&info);
+        MPI_Info_set(info, "alloc_shared_noncontig", "true");
+        double *data;
+        MPI_Win_allocate_shared(capacity_ * sizeof(double), sizeof(double), info, comm_, &data, &win_);
+        MPI_Info_free(&info);
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, win_);
+        for (int rank = 0; rank < int(segments_.size()); ++rank) {
+            MPI_Aint size;
+            int disp_unit;
+            MPI_Win_shared_query(win_, rank, &size, &disp_unit, &segments_[rank]);
+        }
+    }
+
+    /*
+     * Segment of the process `rank` of the node.
+     */
+    double *segment(int rank) const { return segments_[rank]; }
+
+    /*
+     * Order the accesses of this process to the window with respect to
+     * those of the others.
+     */
+    void sync() {
+        if (win_ != MPI_WIN_NULL) {
+            MPI_Win_sync(win_);
+        }
+    }
+};
+
 /*
  * Eigen namespace contains simple wrappers that work with Eigen arrays and automatically deduce the size of the
  * communication buffer. It also contains function for serialization of data.
  */
 namespace Eigen {
 
-template <int i, typename B, typename T> void _pack_buffer_entry(B buffer, T arg) {
-    static_assert(B::RowsAtCompileTime == i + 1, "Your buffer has the wrong number of rows");
-    buffer(i) = arg;
-}
-
-template <int i, typename B, typename T, typename... Ts> void _pack_buffer_entry(B buffer, T arg, Ts... args) {
-    buffer(i) = arg;
-    _pack_buffer_entry<i + 1>(buffer, args...);
-}
-
 /*
- * Serialization: Pack the arguments in order into the buffer
+ * Return the indices of all true entries of a mask, shifted by offset.
  */
-template <typename B, typename... Ts> void pack_buffer_entry(B buffer, Ts... args) {
-    _pack_buffer_entry<0>(buffer, args...);
+template <typename M> ::Eigen::ArrayXi mask_to_indices(const M &mask, ::Eigen::Index offset = 0) {
+    ::Eigen::ArrayXi indices(mask.count());
+    ::Eigen::Index n{0};
+    for (::Eigen::Index i{0}; i < mask.size(); ++i) {
+        if (mask[i]) {
+            indices(n++) = offset + i;
+        }
+    }
+    return indices;
 }
 
-template <int i, typename B, typename T> void _unpack_buffer_entry(B &buffer, T &arg) {
+template <int i, typename B, typename I, typename T> void _gather_buffer_row(B &buffer, const I &indices, const T &arg) {
     static_assert(B::RowsAtCompileTime == i + 1, "Your buffer has the wrong number of rows");
-    arg = buffer(i);
+    buffer.row(i) = arg(indices).template cast<typename B::Scalar>();
 }
 
-template <int i, typename B, typename T, typename... Ts> void _unpack_buffer_entry(B &buffer, T &arg, Ts &...args) {
-    arg = buffer(i);
-    _unpack_buffer_entry<i + 1>(buffer, args...);
+template <int i, typename B, typename I, typename T, typename... Ts>
+void _gather_buffer_row(B &buffer, const I &indices, const T &arg, const Ts &...args) {
+    buffer.row(i) = arg(indices).template cast<typename B::Scalar>();
+    _gather_buffer_row<i + 1>(buffer, indices, args...);
 }
 
 /*
- * Serialization: Unpack the buffer into the arguments in order
+ * Serialize specific entries of a number of arrays into a buffer: column k
+ * holds the entries `indices(k)` of the arrays given in args, in order. Every
+ * row is filled by a single gather over the index list, so arguments can be
+ * expressions, e.g. positions shifted by a periodic offset. Integers beyond
+ * 2^53, e.g. ids, need a buffer of an integer `Scalar` type.
  */
-template <typename B, typename... Ts> void unpack_buffer_entry(B &buffer, Ts &...args) {
-    _unpack_buffer_entry<0>(buffer, args...);
+template <typename Scalar = double, typename I, typename... Ts>
+decltype(auto) gather_buffer(Arena &arena, const I &indices, const Ts &...args) {
+    auto buffer{arena.map<::Eigen::Array<Scalar, sizeof...(Ts), ::Eigen::Dynamic>>(sizeof...(Ts), indices.size())};
+    _gather_buffer_row<0>(buffer, indices, args...);
+    return buffer;
 }
 
 /*
@@ -203,41 +295,45 @@ template <typename B, typename... Ts> void unpack_buffer_entry(B &buffer, Ts &..
  * from the arrays given in args.
  */
 template <typename M, typename... Ts> decltype(auto) pack_buffer(M mask, const Ts &...args) {
-    ::Eigen::Array<double, sizeof...(Ts), ::Eigen::Dynamic> buffer(sizeof...(Ts), mask.count());
-    ::Eigen::Index buffer_index{0};
-    for (::Eigen::Index i{0}; i < mask.size(); ++i) {
-        if (mask[i]) {
-            pack_buffer_entry(buffer.col(buffer_index), args(i)...);
-            buffer_index++;
-        }
-    }
-    assert(buffer_index == mask.count());
+    auto indices{mask_to_indices(mask)};
+    ::Eigen::Array<double, sizeof...(Ts), ::Eigen::Dynamic> buffer(sizeof...(Ts), indices.size());
+    _gather_buffer_row<0>(buffer, indices, args...);
     return buffer;
 }
 
+/*
+ * Same as above, but the buffer is drawn from an arena.
+ */
+template <typename Scalar = double, typename M, typename... Ts>
+decltype(auto) pack_buffer(Arena &arena, M mask, const Ts &...args) {
+    return gather_buffer<Scalar>(arena, mask_to_indices(mask), args...);
+}
+
+template <int i, typename B, typename T> void _unpack_buffer_row(const B &buffer, ::Eigen::Index offset, T &arg) {
+    static_assert(B::RowsAtCompileTime == i + 1, "Your buffer has the wrong number of rows");
+    arg.segment(offset, buffer.cols()) = buffer.row(i).template cast<typename T::Scalar>();
+}
+
+template <int i, typename B, typename T, typename... Ts>
+void _unpack_buffer_row(const B &buffer, ::Eigen::Index offset, T &arg, Ts &...args) {
+    arg.segment(offset, buffer.cols()) = buffer.row(i).template cast<typename T::Scalar>();
+    _unpack_buffer_row<i + 1>(buffer, offset, args...);
+}
+
 /*
  * Deserialize specific entries of a number of arrays into a buffer. All buffer elements are inserted into the
- * arrays given in args starting with the position given by offset.
+ * arrays given in args starting with the position given by offset. Every row is copied into a contiguous
+ * segment of its array.
  */
 template <typename B, typename... Ts> void unpack_buffer(B &buffer, ::Eigen::Index offset, const Ts &...args) {
-    ::Eigen::Index buffer_index{0};
-    for (auto &&buffer_entry : buffer.colwise()) {
-        unpack_buffer_entry(buffer_entry, const_cast<Ts &>(args)(offset + buffer_index)...);
-        buffer_index++;
-    }
+    _unpack_buffer_row<0>(buffer, offset, const_cast<Ts &>(args)...);
 }
 
 /*
  * Call MPI_Sendrecv for data stored in Eigen arrays; deduce data types and size automatically.
  */
-template <typename SendType> decltype(auto) sendrecv(const SendType &sendarr, int dest, int source, MPI_Comm &comm) {
-    // Negotiate buffer sizes.
-    auto nb_recv{MPI::sendrecv(sendarr.cols(), dest, source, comm)};
-
-    // Create receive buffer.
-    using RecvType = ::Eigen::Array<typename SendType::Scalar, SendType::RowsAtCompileTime, ::Eigen::Dynamic>;
-    RecvType recvarr(sendarr.rows(), nb_recv);
-
+template <typename SendType, typename RecvType>
+void _sendrecv(const SendType &sendarr, RecvType &recvarr, int dest, int source, MPI_Comm &comm) {
     // Some trickery: recvbuf for MPI_Sendrecv cannot be NULL, we hence use a dummy buffer when no data is
     // received.
     typename RecvType::Scalar dummy_recv_buffer[1];
@@ -248,7 +344,41 @@ template <typename SendType> decltype(auto) sendrecv(const SendType &sendarr, in
     MPI_Sendrecv(const_cast<SendType &>(sendarr).derived().data(), sendarr.size(),
                  mpi_type<typename SendType::Scalar>(), dest, 0, recv_buffer, recvarr.size(),
                  mpi_type<typename RecvType::Scalar>(), source, 0, comm, nullptr);
+}
+
+template <typename SendType> decltype(auto) sendrecv(const SendType &sendarr, int dest, int source, MPI_Comm &comm) {
+    // Negotiate buffer sizes.
+    auto nb_recv{MPI::sendrecv(sendarr.cols(), dest, source, comm)};
 
+    // Create receive buffer.
+    using RecvType = ::Eigen::Array<typename SendType::Scalar, SendType::RowsAtCompileTime, ::Eigen::Dynamic>;
+    RecvType recvarr(sendarr.rows(), nb_recv);
+    _sendrecv(sendarr, recvarr, dest, source, comm);
+    return recvarr;
+}
+
+/*
+ * Same as above, but the receive buffer is drawn from an arena.
+ */
+template <typename SendType>
+decltype(auto) sendrecv(Arena &arena, const SendType &sendarr, int dest, int source, MPI_Comm &comm) {
+    auto nb_recv{MPI::sendrecv(sendarr.cols(), dest, source, comm)};
+    using RecvType = ::Eigen::Array<typename SendType::Scalar, SendType::RowsAtCompileTime, ::Eigen::Dynamic>;
+    auto recvarr{arena.map<RecvType>(sendarr.rows(), nb_recv)};
+    _sendrecv(sendarr, recvarr, dest, source, comm);
+    return recvarr;
+}
+
+/*
+ * Same as above, for a receive buffer of `nb_recv` columns known from an
+ * earlier exchange with the same processes.
+ */
+template <typename SendType>
+decltype(auto) sendrecv(Arena &arena, const SendType &sendarr, ::Eigen::Index nb_recv, int dest, int source,
+                        MPI_Comm &comm) {
+    using RecvType = ::Eigen::Array<typename SendType::Scalar, SendType::RowsAtCompileTime, ::Eigen::Dynamic>;
+    auto recvarr{arena.map<RecvType>(sendarr.rows(), nb_recv)};
+    _sendrecv(sendarr, recvarr, dest, source, comm);
     return recvarr;
 }
 
@@ -263,6 +393,17 @@ template <typename T> decltype(auto) allreduce(const T &sendarr, MPI_Comm comm)
     return recvarr;
 }
 
+/*
+ * Call MPI_Allreduce with correct data types and reduce all entries of the
+ * array element-wise with `op`.
+ */
+template <typename T> decltype(auto) allreduce(const T &sendarr, MPI_Op op, MPI_Comm comm) {
+    using RecvType = ::Eigen::Array<typename T::Scalar, T::RowsAtCompileTime, T::ColsAtCompileTime>;
+    RecvType recvarr(sendarr.rows(), sendarr.cols());
+    MPI_Allreduce(sendarr.data(), recvarr.data(), sendarr.size(), mpi_type<typename T::Scalar>(), op, comm);
+    return recvarr;
+}
+
 /*
  * Call MPI_Allgather with correct data types.
  */
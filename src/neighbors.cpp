@@ -22,29 +22,58 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 #include <numeric>
 
 #include "neighbors.h"
+#include "omp_support.h"
+
+NeighborList::NeighborList() : NeighborList(5.0) {}
+NeighborList::NeighborList(double cutoff) : NeighborList(cutoff, 0) {}
+NeighborList::NeighborList(double cutoff, double skin)
+    : neighbors_storage_(1), cutoff_{cutoff}, skin_{skin},
+      displacement_{std::numeric_limits<double>::infinity()}, nb_updates_{0} {}
+
+NeighborList::NeighborList(const NeighborList &other)
+    : seed_storage_{other.seed_storage_},
+      neighbors_storage_{other.neighbors_storage_}, cutoff_{other.cutoff_},
+      skin_{other.skin_}, displacement_{other.displacement_},
+      nb_updates_{other.nb_updates_} {
+    bind(other.seed_.size(), other.neighbors_.size());
+}
 
-NeighborList::NeighborList() : seed_{1}, neighbors_{1}, cutoff_{5.0} {}
-NeighborList::NeighborList(double cutoff) : seed_{1}, neighbors_{1}, cutoff_{cutoff} {}
+NeighborList &NeighborList::operator=(const NeighborList &other) {
+    seed_storage_ = other.seed_storage_;
+    neighbors_storage_ = other.neighbors_storage_;
+    cutoff_ = other.cutoff_;
+    skin_ = other.skin_;
+    displacement_ = other.displacement_;
+    nb_updates_ = other.nb_updates_;
+    bind(other.seed_.size(), other.neighbors_.size());
+    return *this;
+}
 
-const std::tuple<const Eigen::ArrayXi &, const Eigen::ArrayXi &>
+const std::tuple<NeighborIndices_t, NeighborIndices_t>
 NeighborList::update(const Atoms &atoms, double cutoff) {
     cutoff_ = cutoff;
     return update(atoms);
 }
 
-const std::tuple<const Eigen::ArrayXi &, const Eigen::ArrayXi &>
+const std::tuple<NeighborIndices_t, NeighborIndices_t>
 NeighborList::update(const Atoms &atoms) {
     // Shorthand for atoms.positions.
     auto &&r{atoms.positions};
+    displacement_ = 0;
+    nb_updates_++;
+
+    // Pairs within the skin are kept so the list stays valid for a few steps
+    auto cutoff{cutoff_ + skin_};
 
     // Avoid computing if atoms is empty
     if (r.size() == 0) {
-      seed_.resize(0);
-      neighbors_.resize(0);
+      bind(0, 0);
       return {seed_, neighbors_};
     }
 
@@ -62,13 +91,13 @@ NeighborList::update(const Atoms &atoms) {
     // number of cells in each Cartesian direction.
     origin = r.rowwise().minCoeff();
     lengths = r.rowwise().maxCoeff() - origin;
-    nb_grid_pts = (lengths / cutoff_).ceil().cast<int>();
+    nb_grid_pts = (lengths / cutoff).ceil().cast<int>();
 
     // Set to 1 if all atoms are in-plane
     nb_grid_pts = (nb_grid_pts <= 0).select(1, nb_grid_pts);
 
     // Pad
-    padding_lengths = nb_grid_pts.cast<double>() * cutoff_ - lengths;
+    padding_lengths = nb_grid_pts.cast<double>() * cutoff - lengths;
     origin -= padding_lengths / 2;
     lengths += padding_lengths;
 
@@ -121,15 +150,13 @@ NeighborList::update(const Atoms &atoms) {
         }
     }
 
-    // We are now in a position to build a neighbor list in linear order. We are
-    // doing a bit of optimization here. Since we have a dynamically growing
-    // list, we don't want to resize every time we add a neighbor. We are
-    // therefore doubling the size when necessary and then resizing once (to a
-    // shorter array) when the list has been build.
-    seed_.resize(atoms.nb_atoms() + 1);
+    // We are now in a position to build a neighbor list in linear order. We
+    // keep the storage for the next update, so that it only grows.
+    if (seed_storage_.size() < atoms.nb_atoms() + 1) {
+        seed_storage_.resize(atoms.nb_atoms() + 1);
+    }
 
-    int n{0};
-    auto cutoffsq{cutoff_ * cutoff_};
+    auto cutoffsq{cutoff * cutoff};
 
     // Constructing index shift vectors to look for neighboring cells
     auto neighborhood = []() {
@@ -144,60 +171,110 @@ NeighborList::update(const Atoms &atoms) {
         return neighborhood;
     }();
 
-    for (int i{0}; i < atoms.nb_atoms(); ++i) {
-        seed_(i) = n;
-
-        Eigen::Array3i cell_coord{
-            (nb_grid_pts.cast<double>() * (r.col(i) - origin) / lengths)
-                .floor()
-                .cast<int>()};
-
-        // Loop over neighboring cells.
-        for (auto &&shift : neighborhood.colwise()) {
-            Eigen::Array3i neigh_cell_coord{cell_coord + shift.array()};
-
-            // Skip if cell is out of bounds
-            if ((neigh_cell_coord < 0).any() ||
-                (neigh_cell_coord >= nb_grid_pts).any())
-                continue;
+    // The atoms are split into contiguous chunks, one per thread. Every thread
+    // collects the neighbors of its chunk in its own buffer; the buffers are
+    // then copied behind each other, such that the list does not depend on
+    // the number of threads.
+    thread_neighbors_.resize(OMP::max_threads());
+    std::vector<int> chunk_offsets(thread_neighbors_.size() + 1, 0);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        int thread{OMP::thread_num()}, nb_threads{OMP::nb_threads()};
+        int begin{static_cast<int>(int64_t(atoms.nb_atoms()) * thread / nb_threads)},
+            end{static_cast<int>(int64_t(atoms.nb_atoms()) * (thread + 1) / nb_threads)};
+        auto &chunk_neighbors{thread_neighbors_[thread]};
+        chunk_neighbors.clear();
+
+        for (int i{begin}; i < end; ++i) {
+            // offset within the chunk for now
+            seed_storage_[i] = chunk_neighbors.size();
+
+            Eigen::Array3i cell_coord{
+                (nb_grid_pts.cast<double>() * (r.col(i) - origin) / lengths)
+                    .floor()
+                    .cast<int>()};
+
+            // Loop over neighboring cells.
+            for (auto &&shift : neighborhood.colwise()) {
+                Eigen::Array3i neigh_cell_coord{cell_coord + shift.array()};
+
+                // Skip if cell is out of bounds
+                if ((neigh_cell_coord < 0).any() ||
+                    (neigh_cell_coord >= nb_grid_pts).any())
+                    continue;
 
-            int cell_index{coordinate_to_index(neigh_cell_coord, nb_grid_pts)};
+                int cell_index{coordinate_to_index(neigh_cell_coord, nb_grid_pts)};
 
-            // Find first entry within the cell neighbor list.
-            auto cell{std::lower_bound(binned_atoms.begin(), binned_atoms.end(),
-                                       cell_index,
-                                       [&](const auto &i, const auto &j) {
-                                           return std::get<0>(i) < j;
-                                       })};
+                // Find first entry within the cell neighbor list.
+                auto cell{std::lower_bound(binned_atoms.begin(), binned_atoms.end(),
+                                           cell_index,
+                                           [&](const auto &i, const auto &j) {
+                                               return std::get<0>(i) < j;
+                                           })};
 
-            if (cell == binned_atoms.end() || std::get<0>(*cell) != cell_index)
-                continue;
+                if (cell == binned_atoms.end() || std::get<0>(*cell) != cell_index)
+                    continue;
 
-            for (int j{std::get<1>(*cell)};
-                 j < atom_to_cell.size() &&
-                 atom_to_cell(sorted_atom_indices(j)) == cell_index;
-                 ++j) {
-                auto neighi{sorted_atom_indices(j)};
+                for (int j{std::get<1>(*cell)};
+                     j < atom_to_cell.size() &&
+                     atom_to_cell(sorted_atom_indices(j)) == cell_index;
+                     ++j) {
+                    auto neighi{sorted_atom_indices(j)};
 
-                // Exclude the atom from being its own neighbor
-                if (neighi == i)
-                    continue;
+                    // Exclude the atom from being its own neighbor
+                    if (neighi == i)
+                        continue;
 
-                auto distance_sq =
-                    (r.col(i) - r.col(neighi)).matrix().squaredNorm();
+                    auto distance_sq =
+                        (r.col(i) - r.col(neighi)).matrix().squaredNorm();
 
-                if (distance_sq <= cutoffsq) {
-                    if (n >= neighbors_.size()) {
-                        neighbors_.conservativeResize(2 * neighbors_.size());
+                    if (distance_sq <= cutoffsq) {
+                        chunk_neighbors.push_back(neighi);
                     }
-                    neighbors_(n) = neighi;
-                    n++;
                 }
             }
         }
+        chunk_offsets[thread + 1] = chunk_neighbors.size();
+
+        // Chunks start behind the neighbors of all previous chunks.
+#ifdef _OPENMP
+#pragma omp barrier
+#pragma omp single
+#endif
+        {
+            std::partial_sum(chunk_offsets.begin(), chunk_offsets.end(), chunk_offsets.begin());
+            if (neighbors_storage_.size() < static_cast<size_t>(chunk_offsets.back())) {
+                neighbors_storage_.resize(chunk_offsets.back());
+            }
+        }
+        for (int i{begin}; i < end; ++i) {
+            seed_storage_[i] += chunk_offsets[thread];
+        }
+        std::copy(chunk_neighbors.begin(), chunk_neighbors.end(),
+                  neighbors_storage_.begin() + chunk_offsets[thread]);
     }
-    seed_(atoms.nb_atoms()) = n;
-    neighbors_.conservativeResize(n);
+    int n{chunk_offsets.back()};
+    seed_storage_[atoms.nb_atoms()] = n;
+    bind(atoms.nb_atoms() + 1, n);
 
     return {seed_, neighbors_};
 }
+
+void NeighborList::split(int nb_local, int nb_forces, std::vector<int> &interior,
+                         std::vector<int> &boundary) const {
+    interior.clear();
+    boundary.clear();
+    for (int i{0}; i < nb_local; ++i) {
+        auto &&j{neighbors_.segment(seed_(i), seed_(i + 1) - seed_(i))};
+        if ((j < nb_local).all()) {
+            interior.push_back(i);
+        } else {
+            boundary.push_back(i);
+        }
+    }
+    for (int i{nb_local}; i < nb_forces; ++i) {
+        boundary.push_back(i);
+    }
+}
@@ -25,26 +25,61 @@
 #ifndef YAMD_NEIGHBORS_H
 #define YAMD_NEIGHBORS_H
 
+#include "aligned_allocator.h"
 #include "atoms.h"
 
+// read-only view of the seed or neighbor array of a neighbor list
+using NeighborIndices_t = Eigen::Map<const Eigen::ArrayXi>;
+
 class NeighborList {
   public:
     NeighborList();
     NeighborList(double cutoff);
+    /*
+     * Neighbor list that contains all pairs within `cutoff + skin`, such that
+     * it stays valid while atoms move by less than half of the skin
+     */
+    NeighborList(double cutoff, double skin);
+
+    // the views have to point to the storage of the copy
+    NeighborList(const NeighborList &other);
+    NeighborList &operator=(const NeighborList &other);
 
     /*
      * Update neighbor list from the particle positons stores in the `atoms`
      * argument
      */
-    const std::tuple<const Eigen::ArrayXi &, const Eigen::ArrayXi &>
+    const std::tuple<NeighborIndices_t, NeighborIndices_t>
     update(const Atoms &atoms);
-    const std::tuple<const Eigen::ArrayXi &, const Eigen::ArrayXi &>
+    const std::tuple<NeighborIndices_t, NeighborIndices_t>
     update(const Atoms &atoms, double cutoff);
 
+    /*
+     * Accumulate the largest displacement of any atom since the last call to
+     * `update` and return whether the list has to be rebuilt. A list that was
+     * never built is stale, and without a skin the list is always stale.
+     */
+    bool is_stale(double max_displacement) {
+        displacement_ += max_displacement;
+        return 2 * displacement_ >= skin_;
+    }
+
+    /*
+     * Extra distance beyond the cutoff, i.e. atoms within `cutoff + skin`
+     * need to be known to build the list
+     */
+    double skin() const { return skin_; }
+
+    /*
+     * Number of calls to `update`, e.g. to recompute quantities derived from
+     * the list only when it has been rebuilt
+     */
+    int nb_updates() const { return nb_updates_; }
+
     /*
      * Return internal seed and neighbor arrays
      */
-    const std::tuple<const Eigen::ArrayXi &, const Eigen::ArrayXi &>
+    const std::tuple<NeighborIndices_t, NeighborIndices_t>
     neighbors() const {
         if (seed_.size() > 0) {
             return {seed_, neighbors_};
@@ -58,8 +93,6 @@ class NeighborList {
      * Return the total number of neighbors found by the last call to `update`
      */
     int nb_neighbors() const {
-        // Note that the length of the `neighbor_` array can be longer than the
-        // total number of neighbors!
         return seed_(seed_.size() - 1);
     }
 
@@ -73,6 +106,16 @@ class NeighborList {
         return seed_(i + 1) - seed_(i);
     }
 
+    /*
+     * Split the atoms [0, nb_forces) into those among the first `nb_local`
+     * whose neighbors are all among the first `nb_local` as well (interior)
+     * and the others (boundary), e.g. to compute forces on interior atoms
+     * while values of ghost atoms are still being communicated. The arrays
+     * keep their capacity between calls.
+     */
+    void split(int nb_local, int nb_forces, std::vector<int> &interior,
+               std::vector<int> &boundary) const;
+
     class iterator {
       // Defining types to be used in std::iterator_traits
       // see https://en.cppreference.com/w/cpp/iterator/iterator_traits
@@ -83,8 +126,8 @@ class NeighborList {
       using iterator_category = std::input_iterator_tag;
 
       public:
-        explicit iterator(const Eigen::ArrayXi &seed,
-                          const Eigen::ArrayXi &neighbors, int i, int n)
+        explicit iterator(const NeighborIndices_t &seed,
+                          const NeighborIndices_t &neighbors, int i, int n)
             : seed_{seed}, neighbors_{neighbors}, i_{i}, n_{n} {}
 
         iterator &operator++() {
@@ -104,8 +147,8 @@ class NeighborList {
         reference operator*() const { return {i_, neighbors_(n_)}; }
 
       protected:
-        const Eigen::ArrayXi &seed_;
-        const Eigen::ArrayXi &neighbors_;
+        NeighborIndices_t seed_;
+        NeighborIndices_t neighbors_;
         int i_, n_;
     };
 
@@ -160,9 +203,28 @@ class NeighborList {
         return coordinate_to_index(c.row(0), c.row(1), c.row(2), nb_grid_pts);
     }
 
-    Eigen::ArrayXi seed_;
-    Eigen::ArrayXi neighbors_;
+    // point the views to the first `nb_seeds` seeds and `nb_pairs` neighbors
+    // of the storage
+    void bind(Eigen::Index nb_seeds, Eigen::Index nb_pairs) {
+        new (&seed_) NeighborIndices_t(seed_storage_.data(), nb_seeds);
+        new (&neighbors_) NeighborIndices_t(neighbors_storage_.data(), nb_pairs);
+    }
+
+    // The storage only grows, such that rebuilding the list neither
+    // allocates nor copies once it has seen the most pairs.
+    PerAtomVector<int> seed_storage_;
+    PerAtomVector<int> neighbors_storage_;
+    // neighbors found by each thread during `update`, kept for the same
+    // reason
+    std::vector<std::vector<int>> thread_neighbors_;
+    NeighborIndices_t seed_{nullptr, 0};
+    NeighborIndices_t neighbors_{nullptr, 0};
     double cutoff_;
+    double skin_;
+    // largest displacement accumulated since the last update, infinite
+    // before the first update
+    double displacement_;
+    int nb_updates_;
 };
 
 #endif  // YAMD_NEIGHBORS_H
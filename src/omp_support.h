@@ -0,0 +1,50 @@
+#ifndef __OMP_SUPPORT_H
+#define __OMP_SUPPORT_H
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Threads within a process. Built with USE_OPENMP, the loops over atoms of the
+// potentials, the neighbor list and the domain decomposition are shared by
+// OpenMP threads; otherwise every process runs a single thread and these
+// functions are trivial.
+namespace OMP {
+// number of threads of the next parallel region of the calling thread
+inline int max_threads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+// number of threads of the enclosing parallel region, 1 outside of one
+inline int nb_threads() {
+#ifdef _OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
+// index of the calling thread within the enclosing parallel region
+inline int thread_num() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+// number of threads of the parallel regions that the calling thread opens
+inline void set_threads(int nb_threads) {
+#ifdef _OPENMP
+    omp_set_num_threads(nb_threads);
+#else
+    (void)nb_threads;
+#endif
+}
+} // namespace OMP
+
+#endif // __OMP_SUPPORT_H
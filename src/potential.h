@@ -0,0 +1,27 @@
+#ifndef __POTENTIAL_H
+#define __POTENTIAL_H
+
+// Floating point precision used for the pair geometry inside the force
+// kernels. Forces, energies and the integration always stay in double
+// precision, only distances and pair terms are evaluated in single precision
+// with the `Mixed` setting.
+enum class Precision { Double, Mixed };
+
+// Parts of a potential that are evaluated, e.g. to integrate the stiff
+// short-ranged repulsion with a smaller timestep than the smoother embedding
+// contribution. Potentials without such a split only support `All`.
+enum class ForceTerms { All, Repulsive, Embedding };
+
+// Options that control how a potential is evaluated.
+struct PotentialOptions {
+    Precision precision = Precision::Double;
+    // Compute the potential energy. Forces are always computed; if this is
+    // turned off the potential returns zero instead of the energy.
+    bool energy = true;
+    // Also compute forces on ghost atoms (all atoms beyond nb_local), e.g. to
+    // measure the stress across a domain boundary.
+    bool ghost_forces = false;
+    ForceTerms terms = ForceTerms::All;
+};
+
+#endif // __POTENTIAL_H
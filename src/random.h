@@ -0,0 +1,65 @@
+#ifndef __RANDOM_H
+#define __RANDOM_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+// Counter-based random number generator Philox4x32-10 (Salmon et al., "Parallel
+// random numbers: as easy as 1, 2, 3", SC'11). Every counter maps to four
+// independent random numbers, so streams can be keyed on e.g. an atom id and a
+// timestep and need neither state nor communication to be reproducible.
+class Philox {
+  public:
+    using Counter = std::array<uint32_t, 4>;
+
+  private:
+    std::array<uint32_t, 2> key_;
+
+    static void round(Counter &counter, const std::array<uint32_t, 2> &key) {
+        uint64_t product0{uint64_t{0xD2511F53} * counter[0]};
+        uint64_t product1{uint64_t{0xCD9E8D57} * counter[2]};
+        counter = {uint32_t(product1 >> 32) ^ counter[1] ^ key[0], uint32_t(product1),
+                   uint32_t(product0 >> 32) ^ counter[3] ^ key[1], uint32_t(product0)};
+    }
+
+  public:
+    Philox(uint64_t seed) : key_{uint32_t(seed), uint32_t(seed >> 32)} {}
+
+    // four random 32 bit integers for the given counter
+    Counter operator()(Counter counter) const {
+        auto key{key_};
+        for (int i = 0; i < 10; i++) {
+            if (i > 0) {
+                key[0] += 0x9E3779B9;
+                key[1] += 0xBB67AE85;
+            }
+            round(counter, key);
+        }
+        return counter;
+    }
+
+    // four random numbers uniformly distributed in (0, 1]
+    std::array<double, 4> uniform(Counter counter) const {
+        auto bits{(*this)(counter)};
+        std::array<double, 4> values;
+        for (int i = 0; i < 4; i++) {
+            values[i] = (bits[i] + 1.0) / 4294967296.0;
+        }
+        return values;
+    }
+
+    // four independent standard normal random numbers (Box-Muller transform)
+    std::array<double, 4> normal(Counter counter) const {
+        auto u{uniform(counter)};
+        std::array<double, 4> values;
+        for (int i = 0; i < 4; i += 2) {
+            double radius{std::sqrt(-2 * std::log(u[i]))};
+            values[i] = radius * std::cos(2 * M_PI * u[i + 1]);
+            values[i + 1] = radius * std::sin(2 * M_PI * u[i + 1]);
+        }
+        return values;
+    }
+};
+
+#endif // __RANDOM_H
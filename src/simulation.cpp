@@ -0,0 +1,101 @@
+#include "simulation.h"
+#include "ducastelle.h"
+#include "verlet.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+std::vector<Simulation::Entry>::iterator Simulation::find(const std::string &name) {
+    auto it = std::find_if(stages_.begin(), stages_.end(), [&](const Entry &entry) { return entry.name == name; });
+    if (it == stages_.end()) {
+        throw std::runtime_error("Unknown stage: " + name);
+    }
+    return it;
+}
+
+void Simulation::add(const std::string &name, Stage stage, Schedule schedule) {
+    stages_.push_back({name, std::move(stage), schedule});
+}
+
+void Simulation::insert_before(const std::string &position, const std::string &name, Stage stage,
+                               Schedule schedule) {
+    stages_.insert(find(position), {name, std::move(stage), schedule});
+}
+
+void Simulation::insert_after(const std::string &position, const std::string &name, Stage stage,
+                              Schedule schedule) {
+    stages_.insert(find(position) + 1, {name, std::move(stage), schedule});
+}
+
+void Simulation::replace(const std::string &name, Stage stage) {
+    find(name)->stage = std::move(stage);
+}
+
+void Simulation::remove(const std::string &name) {
+    stages_.erase(find(name));
+}
+
+void Simulation::move_before(const std::string &name, const std::string &position) {
+    Entry entry{*find(name)};
+    remove(name);
+    stages_.insert(find(position), std::move(entry));
+}
+
+bool Simulation::contains(const std::string &name) const {
+    return std::any_of(stages_.begin(), stages_.end(), [&](const Entry &entry) { return entry.name == name; });
+}
+
+std::vector<std::string> Simulation::stages() const {
+    std::vector<std::string> names;
+    for (const auto &entry : stages_) {
+        names.push_back(entry.name);
+    }
+    return names;
+}
+
+Step Simulation::run(size_t begin, size_t end) {
+    Step step{begin, timestep_, false};
+    step.ekin = ekin_;
+    for (size_t ts = begin; ts < end; ts++) {
+        step = Step{ts, timestep_, output_interval_ > 0 && ts % output_interval_ == 0, 0, step.ekin};
+        // temporaries of all stages are released at the end of the step
+        Arena::Scope scope{step_arena()};
+        for (auto &entry : stages_) {
+            if (!entry.schedule.due(ts)) {
+                continue;
+            }
+            auto start = std::chrono::steady_clock::now();
+            entry.stage(step);
+            entry.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            entry.calls++;
+        }
+        arena_peak_ = std::max(arena_peak_, step_arena().used());
+    }
+    ekin_ = step.ekin;
+    return step;
+}
+
+std::vector<Simulation::Timing> Simulation::timings() const {
+    std::vector<Timing> timings;
+    for (const auto &entry : stages_) {
+        timings.push_back({entry.name, entry.seconds, entry.calls});
+    }
+    return timings;
+}
+
+void add_verlet_stages(Simulation &simulation, Atoms &atoms, NeighborList &neighbor_list,
+                       PotentialOptions &potential_options, double cutoff) {
+    simulation.add("verlet1", [&atoms](Step &step) { step.displacement = verlet_step1(atoms, step.timestep); });
+    simulation.add("neighbors", [&atoms, &neighbor_list](Step &step) {
+        if (neighbor_list.is_stale(step.displacement)) {
+            neighbor_list.update(atoms);
+        }
+    });
+    simulation.add("forces", [&atoms, &neighbor_list, &potential_options, cutoff](Step &step) {
+        potential_options.energy = step.output;
+        step.epot = ducastelle(atoms, neighbor_list, atoms.nb_atoms(), potential_options, cutoff);
+    });
+    simulation.add("verlet2", [&atoms](Step &step) {
+        step.ekin = verlet_step2(atoms, step.timestep, step.velocity_scale, atoms.nb_atoms());
+    });
+}
@@ -0,0 +1,114 @@
+#ifndef __SIMULATION_H
+#define __SIMULATION_H
+
+#include "arena.h"
+#include "atoms.h"
+#include "neighbors.h"
+#include "potential.h"
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+
+// State of the current step that is shared by the stages of a simulation
+struct Step {
+    // index of the step
+    size_t ts;
+    // length of the step
+    double timestep;
+    // whether this step writes output, e.g. potential energies are only
+    // evaluated and reduced then
+    bool output;
+    // energies of the local atoms, of all atoms once they are reduced. Until
+    // the corrector step `ekin` holds the kinetic energy of the previous step,
+    // e.g. for thermostats that are folded into the corrector step.
+    double epot = 0;
+    double ekin = 0;
+    // largest displacement of any atom in this step
+    double displacement = 0;
+    // scaling of the velocities in the corrector step, e.g. by a thermostat
+    double velocity_scale = 1;
+};
+
+// Steps [begin, end) at which a stage runs, every `interval` steps; an
+// interval of 0 never runs
+struct Schedule {
+    size_t interval = 1;
+    size_t begin = 0;
+    size_t end = std::numeric_limits<size_t>::max();
+
+    bool due(size_t ts) const {
+        return interval > 0 && ts >= begin && ts < end && (ts - begin) % interval == 0;
+    }
+};
+
+// A simulation step as a pipeline of named stages, e.g. the predictor step,
+// the neighbor search, the forces and the corrector step. Thermostats, energy
+// pumps, analysis and output are stages as well, each with its own schedule.
+// Stages can be inserted, replaced and reordered by name, e.g. to start the
+// communication of ghost atoms before and finish it after local work. The wall
+// time of every stage is accumulated.
+class Simulation {
+  public:
+    using Stage = std::function<void(Step &)>;
+
+    struct Timing {
+        std::string name;
+        double seconds;
+        size_t calls;
+    };
+
+  private:
+    struct Entry {
+        std::string name;
+        Stage stage;
+        Schedule schedule;
+        double seconds = 0;
+        size_t calls = 0;
+    };
+    std::vector<Entry> stages_;
+    double timestep_;
+    size_t output_interval_;
+    // kinetic energy at the end of the last step
+    double ekin_ = 0;
+    // most memory any step drew from the step arena
+    size_t arena_peak_ = 0;
+
+    std::vector<Entry>::iterator find(const std::string &name);
+
+  public:
+    // `output_interval` 0 never writes output
+    Simulation(double timestep, size_t output_interval) : timestep_(timestep), output_interval_(output_interval) {}
+
+    double timestep() const { return timestep_; }
+    void set_timestep(double timestep) { timestep_ = timestep; }
+
+    // append a stage to the end of the step
+    void add(const std::string &name, Stage stage, Schedule schedule = {});
+    // insert a stage before or after the stage `position`
+    void insert_before(const std::string &position, const std::string &name, Stage stage, Schedule schedule = {});
+    void insert_after(const std::string &position, const std::string &name, Stage stage, Schedule schedule = {});
+    // replace the work of a stage, keeping its position and schedule
+    void replace(const std::string &name, Stage stage);
+    void remove(const std::string &name);
+    // move the stage `name` right before the stage `position`
+    void move_before(const std::string &name, const std::string &position);
+    bool contains(const std::string &name) const;
+    // names of the stages in the order they run
+    std::vector<std::string> stages() const;
+
+    // run the steps [begin, end); returns the state of the last step
+    Step run(size_t begin, size_t end);
+    // accumulated wall time of each stage
+    std::vector<Timing> timings() const;
+    // most bytes of temporaries any step drew from the step arena
+    size_t arena_peak() const { return arena_peak_; }
+};
+
+// Stages of a velocity verlet step with the embedded atom potential on all
+// atoms: "verlet1", "neighbors", "forces" and "verlet2". The neighbor list is
+// only rebuilt once atoms moved through its skin.
+void add_verlet_stages(Simulation &simulation, Atoms &atoms, NeighborList &neighbor_list,
+                       PotentialOptions &potential_options, double cutoff);
+
+#endif // __SIMULATION_H
@@ -0,0 +1,200 @@
+#ifndef __SIMULATION_MPI_H
+#define __SIMULATION_MPI_H
+
+#include "atoms.h"
+#include "domain.h"
+#include "ducastelle.h"
+#include "minimizer.h"
+#include "mpi_support.h"
+#include "neighbors.h"
+#include "potential.h"
+#include "simulation.h"
+#include "simulation_utils.h"
+#include "thermo_mpi.h"
+#include "thermostat.h"
+#include "verlet.h"
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Stages of a velocity verlet step with the embedded atom potential on a
+// decomposed domain: "verlet1", "exchange", "ghosts", "neighbors", "density",
+// "ghost_positions", "ghost_values", "interior_forces", "ghost_values_finish",
+// "forces", "verlet2", "reduce" and "reduced". Atoms only change subdomains
+// and ghosts are only rebuilt when the neighbor list is stale on any rank; in
+// between, only positions of ghosts are communicated, and they are in flight
+// while the densities of interior atoms, whose neighbors are all local, are
+// computed. Densities of ghosts are in flight while forces on interior atoms
+// are computed; forces on the remaining atoms follow in "forces". The split
+// into interior and boundary atoms is only redone when the neighbor list has
+// been rebuilt. "reduce" posts the reduction of the energies and of all
+// further observables of `thermo`, stages inserted before "reduced" overlap
+// with it. Up to "reduced" the energies are those of the local atoms,
+// afterwards those of all atoms; the potential energy is only evaluated on
+// output steps.
+void add_domain_stages(Simulation &simulation, Atoms &atoms, Domain &domain, ThermoReduction &thermo,
+                       NeighborList &neighbor_list, PotentialOptions &potential_options, double cutoff) {
+    // the phases of the potential, its buffers live in the step arena from
+    // the "density" to the "forces" stage
+    auto eam = std::make_shared<std::optional<DucastellePhases>>();
+    // atoms whose densities and forces need no ghosts and the others, local
+    // ones first, as of the neighbor list update `split_update`
+    auto interior = std::make_shared<std::vector<int>>(), boundary = std::make_shared<std::vector<int>>();
+    auto nb_local_boundary = std::make_shared<int>(), split_update = std::make_shared<int>(-1);
+    auto indices = [](const std::vector<int> &v, size_t n) { return Eigen::Map<const Eigen::ArrayXi>(v.data(), n); };
+    simulation.add("verlet1", [&atoms](Step &step) { step.displacement = verlet_step1(atoms, step.timestep); });
+    // whether this step rebuilds the ghosts and the neighbor list
+    auto rebuild = std::make_shared<bool>();
+    simulation.add("exchange", [&atoms, &domain, &neighbor_list, rebuild](Step &step) {
+        // without a skin the list is always stale, no need to reduce
+        double displacement = neighbor_list.skin() > 0
+                                  ? MPI::allreduce(step.displacement, MPI_MAX, domain.communicator())
+                                  : step.displacement;
+        *rebuild = neighbor_list.is_stale(displacement) || !domain.ghosts_valid();
+        if (*rebuild) {
+            domain.exchange_atoms(atoms);
+        }
+    });
+    simulation.add("ghosts", [&atoms, &domain, &neighbor_list, cutoff, rebuild](Step &) {
+        if (*rebuild) {
+            domain.update_ghosts(atoms, cutoff + neighbor_list.skin());
+        } else {
+            domain.begin_update_ghost_positions(atoms);
+        }
+    });
+    simulation.add("neighbors", [=, &atoms, &domain, &neighbor_list, &potential_options](Step &) {
+        if (*rebuild) {
+            neighbor_list.update(atoms);
+        }
+        if (*split_update != neighbor_list.nb_updates()) {
+            int nb_forces = potential_options.ghost_forces ? atoms.nb_atoms() : domain.nb_local();
+            neighbor_list.split(domain.nb_local(), nb_forces, *interior, *boundary);
+            *nb_local_boundary = domain.nb_local() - interior->size();
+            *split_update = neighbor_list.nb_updates();
+        }
+    });
+    simulation.add("density", [=, &atoms, &domain, &neighbor_list, &potential_options](Step &step) {
+        potential_options.energy = step.output;
+        eam->emplace(atoms, neighbor_list, domain.nb_local(), potential_options, cutoff);
+        (*eam)->density(indices(*interior, interior->size()));
+    });
+    simulation.add("ghost_positions", [=, &atoms, &domain](Step &) {
+        if (!*rebuild) {
+            domain.finish_update_ghost_positions(atoms);
+        }
+        (*eam)->ghost_positions();
+        (*eam)->density(indices(*boundary, *nb_local_boundary));
+    });
+    simulation.add("ghost_values", [=, &domain](Step &) { domain.begin_update_ghost_values((*eam)->densities()); });
+    simulation.add("interior_forces", [=, &atoms](Step &step) {
+        atoms.forces.setZero();
+        step.epot = (*eam)->forces(indices(*interior, interior->size()));
+    });
+    simulation.add("ghost_values_finish", [=, &domain](Step &) {
+        domain.finish_update_ghost_values((*eam)->densities());
+        (*eam)->ghost_densities();
+    });
+    simulation.add("forces", [=](Step &step) {
+        step.epot += (*eam)->forces(indices(*boundary, boundary->size()));
+        eam->reset();
+    });
+    simulation.add("verlet2", [&atoms, &domain](Step &step) {
+        step.ekin = verlet_step2(atoms, step.timestep, step.velocity_scale, domain.nb_local());
+    });
+    simulation.add("reduce", [&thermo](Step &step) {
+        thermo.set(ThermoReduction::ekin, step.ekin);
+        thermo.set(ThermoReduction::epot, step.output ? step.epot : 0);
+        thermo.begin();
+    });
+    simulation.add("reduced", [&thermo](Step &step) {
+        thermo.finish();
+        step.ekin = thermo.get(ThermoReduction::ekin);
+        step.epot = thermo.get(ThermoReduction::epot);
+    });
+}
+
+// Relax the geometry of the decomposed atoms with the FIRE minimizer into the
+// nearest minimum of the potential (--minimize), with the timestep of the
+// integrator as initial timestep. Atoms at rest cannot be heated by a
+// thermostat, so the atoms start from random velocities at twice the target
+// temperature; about half of the kinetic energy flows into the potential
+// energy. The velocities carry no net momentum and do not depend on the
+// number of processes.
+MinimizerResult minimize_domain(Atoms &atoms, Domain &domain, NeighborList &neighbor_list,
+                                const PotentialOptions &potential_options, const SimulationParameters &sim,
+                                double fmax) {
+    FireParameters fire;
+    fire.fmax = fmax;
+    fire.timestep = sim.timestep();
+    fire.max_timestep = 10 * sim.timestep();
+    MinimizerReductions reductions;
+    reductions.sum = [&domain](const Eigen::Array3d &x) -> Eigen::Array3d {
+        return MPI::Eigen::allreduce(x, MPI_SUM, domain.communicator());
+    };
+    reductions.max = [&domain](double x) { return MPI::allreduce(x, MPI_MAX, domain.communicator()); };
+    auto compute_forces = [&](double) {
+        domain.exchange_atoms(atoms);
+        domain.update_ghosts(atoms, sim.cutoff() + sim.skin());
+        neighbor_list.update(atoms);
+        auto density{ducastelle_density(atoms, neighbor_list, domain.nb_local(), potential_options, sim.cutoff())};
+        domain.update_ghost_values(density);
+        ducastelle_forces(atoms, neighbor_list, density, domain.nb_local(), potential_options, sim.cutoff());
+        return domain.nb_local();
+    };
+    auto result = fire_minimize(atoms, compute_forces, fire, reductions);
+
+    int nb_local = domain.nb_local();
+    random_velocities(atoms, 2 * sim.target_temperature(), sim.seed(), nb_local);
+    auto &&velocities{atoms.velocities.leftCols(nb_local)};
+    auto &&masses{atoms.masses.head(nb_local)};
+    Eigen::Array3d momentum = MPI::Eigen::allreduce(
+        Eigen::Array3d{(velocities.rowwise() * masses.transpose()).rowwise().sum()}, MPI_SUM, domain.communicator());
+    double mass = MPI::allreduce(masses.sum(), MPI_SUM, domain.communicator());
+    velocities.colwise() -= momentum / mass;
+    int nb_atoms = MPI::allreduce(nb_local, MPI_SUM, domain.communicator());
+    double ekin = MPI::allreduce(atoms.kinetic_energy(nb_local), MPI_SUM, domain.communicator());
+    velocities *= std::sqrt(2 * sim.target_temperature() / atoms.temperature(ekin, nb_atoms));
+    return result;
+}
+
+// Thermostat of the initial relaxation as selected with --thermostat. The
+// Berendsen and Bussi thermostats scale the velocities with the reduced
+// kinetic energy and update it to the scaled velocities for later stages. The Langevin thermostat is folded into the corrector step
+// and needs no reduction, so the "reduce" and "reduced" stages are dropped.
+void add_thermostat_stage(Simulation &simulation, Atoms &atoms, Domain &domain, Equilibrium &equilibrium,
+                          const SimulationParameters &sim) {
+    int nb_atoms = MPI::allreduce(domain.nb_local(), MPI_SUM, domain.communicator());
+    switch (sim.thermostat()) {
+    case ThermostatType::Berendsen:
+        simulation.add("thermostat", [&atoms, &equilibrium, nb_atoms](Step &step) {
+            double scale = equilibrium.scale(step.ts, atoms.temperature(step.ekin, nb_atoms));
+            atoms.velocities *= scale;
+            step.ekin *= scale * scale;
+        });
+        break;
+    case ThermostatType::Bussi: {
+        BussiThermostat thermostat(sim.target_temperature(), sim.relaxation_time(), sim.seed());
+        simulation.add("thermostat", [&atoms, &equilibrium, nb_atoms, thermostat](Step &step) {
+            if (equilibrium.active(step.ts)) {
+                double scale = thermostat.scale(step.ekin, nb_atoms, step.timestep, step.ts);
+                atoms.velocities *= scale;
+                step.ekin *= scale * scale;
+            }
+        });
+        break;
+    }
+    case ThermostatType::Langevin: {
+        LangevinThermostat thermostat(sim.target_temperature(), sim.relaxation_time(), sim.seed());
+        simulation.replace("verlet2", [&atoms, &domain, &equilibrium, thermostat](Step &step) {
+            step.ekin = equilibrium.active(step.ts)
+                            ? verlet_step2(atoms, step.timestep, thermostat, step.ts, domain.nb_local())
+                            : verlet_step2(atoms, step.timestep, step.velocity_scale, domain.nb_local());
+        });
+        simulation.remove("reduce");
+        simulation.remove("reduced");
+        break;
+    }
+    }
+}
+
+#endif // __SIMULATION_MPI_H
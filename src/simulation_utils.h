@@ -2,6 +2,8 @@
 #define __SIMULATION_UTILS_H
 
 #include "atoms.h"
+#include "potential.h"
+#include "thermostat.h"
 #include <argparse/argparse.hpp>
 #include <iostream>
 
@@ -19,6 +21,11 @@ class SimulationParameters {
     double length_increase_;
     double delta_Q_;
     size_t relaxation_time_deposit_;
+    Precision precision_;
+    double skin_;
+    size_t respa_steps_;
+    ThermostatType thermostat_;
+    uint64_t seed_;
 
   public:
     SimulationParameters(argparse::ArgumentParser& parser) {
@@ -33,6 +40,20 @@ class SimulationParameters {
         length_increase_ = parser.get<double>("--stretch");
         delta_Q_ = parser.get<double>("--deposit_energy");
         relaxation_time_deposit_ = parser.get<size_t>("--relaxation_time_deposit");
+        precision_ = parser.get<bool>("--mixed_precision") ? Precision::Mixed : Precision::Double;
+        skin_ = parser.get<double>("--skin");
+        respa_steps_ = parser.get<size_t>("--respa_steps");
+        auto thermostat = parser.get<std::string>("--thermostat");
+        if (thermostat == "berendsen") {
+            thermostat_ = ThermostatType::Berendsen;
+        } else if (thermostat == "langevin") {
+            thermostat_ = ThermostatType::Langevin;
+        } else if (thermostat == "bussi") {
+            thermostat_ = ThermostatType::Bussi;
+        } else {
+            throw std::runtime_error("Unknown thermostat: " + thermostat);
+        }
+        seed_ = parser.get<size_t>("--seed");
     }
     ~SimulationParameters() {}
     double timestep() const { return timestep_; }
@@ -46,6 +67,11 @@ class SimulationParameters {
     double length_increase() const { return length_increase_; }
     double delta_Q() const { return delta_Q_; }
     size_t relaxation_time_deposit() const { return relaxation_time_deposit_; }
+    Precision precision() const { return precision_; }
+    double skin() const { return skin_; }
+    size_t respa_steps() const { return respa_steps_; }
+    ThermostatType thermostat() const { return thermostat_; }
+    uint64_t seed() const { return seed_; }
 };
 
 
@@ -72,9 +98,22 @@ argparse::ArgumentParser default_parser(const char* name) {
     parser.add_argument("--traj")
         .help("If set write trajectory to xyz. Optionally takes a path for the output file.")
         .nargs(argparse::nargs_pattern::optional);
+    parser.add_argument("--checkpoint")
+        .help("If set write the final state to xyz with full precision (MPI only). Optionally takes a path for the "
+              "output file.")
+        .nargs(argparse::nargs_pattern::optional);
     parser.add_argument("-i", "--input")
         .help("Takes a path for the input file.")
         .nargs(1);
+    parser.add_argument("--inputs")
+        .help("Takes paths for several input files that are simulated side by side.")
+        .nargs(argparse::nargs_pattern::at_least_one);
+    parser.add_argument("--threads")
+        .help("The number of threads, per process with MPI. 0 uses all available cores, shared evenly among the "
+              "processes of a node.")
+        .nargs(1)
+        .default_value<size_t>(0)
+        .scan<'u', size_t>();
     parser.add_argument("--smoothing")
         .help("Smoothing factor for exponential average.")
         .nargs(1)
@@ -91,11 +130,48 @@ argparse::ArgumentParser default_parser(const char* name) {
         .nargs(1)
         .default_value<double>(1.0)
         .scan<'g', double>();
+    parser.add_argument("--respa_steps")
+        .help("Number of inner steps of the multiple timestep integrator, the slow forces are evaluated once per <respa_steps> timesteps. 1 uses plain velocity verlet.")
+        .nargs(1)
+        .default_value<size_t>(1)
+        .scan<'u', size_t>();
+    parser.add_argument("--adaptive_timestep")
+        .help("Adapt the timestep to the largest displacement, force and energy drift.")
+        .default_value(false)
+        .implicit_value(true);
+    parser.add_argument("--timestep_limits")
+        .help("The smallest and largest timestep in femtoseconds the adaptive timestep may use.")
+        .nargs(2)
+        .default_value(std::vector<double>{0.1, 5.0})
+        .scan<'g', double>();
+    parser.add_argument("--max_displacement")
+        .help("The largest distance in angstrom any atom may move in one adaptive timestep.")
+        .nargs(1)
+        .default_value<double>(0.1)
+        .scan<'g', double>();
+    parser.add_argument("--max_drift")
+        .help("The largest energy drift in eV per atom and femtosecond the adaptive timestep tolerates.")
+        .nargs(1)
+        .default_value<double>(1e-5)
+        .scan<'g', double>();
+    parser.add_argument("--minimize")
+        .help("Relax the geometry with the FIRE minimizer before the initial thermostat relaxation.")
+        .default_value(false)
+        .implicit_value(true);
+    parser.add_argument("--fmax")
+        .help("The minimizer stops once no force is larger than <fmax> eV/Å.")
+        .nargs(1)
+        .default_value<double>(1e-2)
+        .scan<'g', double>();
     parser.add_argument("--mass")
         .help("The mass of the atoms in g/mol.")
         .nargs(1)
         .default_value<double>(1.0)
         .scan<'g', double>();
+    parser.add_argument("--mixed_precision")
+        .help("Evaluate pair geometry in the force kernels in single precision.")
+        .default_value(false)
+        .implicit_value(true);
     // lennard-jones
     parser.add_argument("--sigma")
         .help("The σ parameter for the lennard-jones potential.")
@@ -128,6 +204,15 @@ argparse::ArgumentParser default_parser(const char* name) {
         .nargs(1)
         .default_value<size_t>(1000)
         .scan<'u', size_t>();
+    parser.add_argument("--thermostat")
+        .help("The thermostat of the initial relaxation: berendsen, langevin or bussi.")
+        .nargs(1)
+        .default_value(std::string("berendsen"));
+    parser.add_argument("--seed")
+        .help("Seed of the random numbers of the langevin and bussi thermostats.")
+        .nargs(1)
+        .default_value<size_t>(0)
+        .scan<'u', size_t>();
     parser.add_argument("--thermostat_factor")
         .help("Fraction of the initial relaxation time to run the thermosthat for.")
         .nargs(1)
@@ -154,11 +239,16 @@ argparse::ArgumentParser default_parser(const char* name) {
         .nargs(1)
         .default_value<double>(5.0)
         .scan<'g', double>();
+    parser.add_argument("--skin")
+        .help("Extra distance added to the cutoff of the neighbor list, so it only needs to be rebuilt every few steps.")
+        .nargs(1)
+        .default_value<double>(0.0)
+        .scan<'g', double>();
     parser.add_argument("--domains")
-        .help("The number of domains in x, y, z direction.")
-        .nargs(3)
-        .default_value(std::vector<int>{1, 1, 1})
-        .scan<'i', int>();
+        .help("The number of domains in x, y, z direction, or auto to choose them from the number of processes "
+              "and the shape of the system.")
+        .nargs(argparse::nargs_pattern::at_least_one)
+        .default_value(std::vector<std::string>{"1", "1", "1"});
     parser.add_argument("--periodic")
         .help("The periodicity of domains in x, y, z direction, 1 means periodic, 0 not.")
         .nargs(3)
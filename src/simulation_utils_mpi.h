@@ -2,9 +2,18 @@
 #define __SIMULATION_UTILS_MPI_H
 
 #include "atoms.h"
+#include "decomposition.h"
 #include "domain.h"
+#include "omp_support.h"
+#include "writer_mpi.h"
+#include <algorithm>
 #include <argparse/argparse.hpp>
+#include <cmath>
 #include <Eigen/Dense>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
 
 class Stretcher {
   private:
@@ -27,14 +36,29 @@ class Stretcher {
     double strain() { return strain_; }
 };
 
-Domain init_domain(Atoms& atoms, argparse::ArgumentParser parser) {
-    auto ds = parser.get<std::vector<int>>("--domains");
+// Domain of all processes as selected with --domains, --periodic and
+// --shift_atoms. With --domains auto, the decomposition with the least atoms
+// including ghosts on the busiest process is chosen from the bounding box of
+// the atoms, see choose_decomposition, and logged.
+Domain init_domain(Atoms& atoms, argparse::ArgumentParser parser, MPIWriter& writer) {
+    auto domains = parser.get<std::vector<std::string>>("--domains");
+    bool automatic = domains.size() == 1 && domains[0] == "auto";
+    if (!automatic && domains.size() != 3) {
+        throw std::runtime_error("--domains takes three numbers or auto");
+    }
     auto periodic = parser.get<std::vector<int>>("--periodic");
     double shift = parser.get<double>("--shift_atoms");
     bool verbose = parser.get<bool>("--verbose");
 
-    auto max_pos = atoms.positions.rowwise().maxCoeff();
-    auto min_pos = atoms.positions.rowwise().minCoeff();
+    // bounds of the atoms of all processes, they may hold any part of them
+    Eigen::Array3d max_pos{Eigen::Array3d::Constant(-std::numeric_limits<double>::infinity())};
+    Eigen::Array3d min_pos{Eigen::Array3d::Constant(std::numeric_limits<double>::infinity())};
+    if (atoms.nb_atoms() > 0) {
+        max_pos = atoms.positions.rowwise().maxCoeff();
+        min_pos = atoms.positions.rowwise().minCoeff();
+    }
+    max_pos = MPI::Eigen::allreduce(max_pos, MPI_MAX, MPI_COMM_WORLD);
+    min_pos = MPI::Eigen::allreduce(min_pos, MPI_MIN, MPI_COMM_WORLD);
     // bounding box
     Eigen::Array3d bbox{max_pos(0) - min_pos(0),
                         max_pos(1) - min_pos(1),
@@ -53,15 +77,67 @@ Domain init_domain(Atoms& atoms, argparse::ArgumentParser parser) {
     double box_sz_y = periodic[1] == 0 ? bbox(1) + 2 * bbox(1) * shift : max_pos(1) + min_pos(1);
     double box_sz_z = periodic[2] == 0 ? bbox(2) + 2 * bbox(2) * shift : max_pos(2) + min_pos(2);
 
+    Eigen::Array3d box{box_sz_x, box_sz_y, box_sz_z};
+
+    Eigen::Array3i ds;
+    if (automatic) {
+        double nb_atoms = MPI::allreduce(atoms.nb_atoms(), MPI_SUM, MPI_COMM_WORLD);
+        // the atoms in non-periodic directions were shifted into the box
+        Eigen::Array3d lower{min_pos}, upper{max_pos};
+        for (size_t i = 0; i < 3; i++) {
+            if (periodic[i] == 0) {
+                lower(i) += offset(i);
+                upper(i) += offset(i);
+            }
+        }
+        auto choice = choose_decomposition(MPI::comm_size(MPI_COMM_WORLD), nb_atoms, lower, upper, box,
+                                           {periodic[0], periodic[1], periodic[2]},
+                                           parser.get<double>("--cutoff") + parser.get<double>("--skin"));
+        ds = choice.decomposition;
+        writer.log("domains (auto): ", std::to_string(ds(0)) + " " + std::to_string(ds(1)) + " " +
+                                           std::to_string(ds(2)) + ", busiest process ~" +
+                                           std::to_string(std::lround(choice.atoms)) +
+                                           " atoms with ghosts, load imbalance " + std::to_string(choice.imbalance));
+    } else {
+        for (size_t i = 0; i < 3; i++) {
+            ds(i) = std::stoi(domains[i]);
+        }
+    }
+
     Domain domain(MPI_COMM_WORLD,
-        {box_sz_x, box_sz_y, box_sz_z},
-        {ds[0], ds[1], ds[2]},
+        box,
+        ds,
         {periodic[0], periodic[1], periodic[2]},
         verbose
     );
     return domain;
 }
 
+// Threads per process as selected with --threads, e.g. 8 processes with 8
+// threads each on a node of 64 cores: mpirun -np 8 ... --threads 8. With 0 the
+// processes of a node share its cores evenly. Returns the number of threads,
+// which is 1 unless built with USE_OPENMP.
+int init_threads(argparse::ArgumentParser& parser, MPI_Comm comm) {
+    int nb_threads = parser.get<size_t>("--threads");
+    if (nb_threads == 0) {
+        MPI_Comm node;
+        MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node);
+        int nb_node_processes;
+        MPI_Comm_size(node, &nb_node_processes);
+        MPI_Comm_free(&node);
+        nb_threads = std::max<int>(1, std::thread::hardware_concurrency() / nb_node_processes);
+    }
+    OMP::set_threads(nb_threads);
+
+    // only the main thread calls MPI, outside of the parallel loops
+    int provided;
+    MPI_Query_thread(&provided);
+    if (OMP::max_threads() > 1 && provided < MPI_THREAD_FUNNELED) {
+        throw std::runtime_error("MPI does not support threads, use --threads 1");
+    }
+    return OMP::max_threads();
+}
+
 double compute_stress(const Domain& domain, const Atoms& atoms, int dim = 2) {
     double left_domain_boundary{domain.coordinate(dim) * domain.domain_length(dim) / domain.decomposition(dim)};
     auto left_mask{atoms.positions.row(dim) < left_domain_boundary};
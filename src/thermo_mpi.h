@@ -0,0 +1,68 @@
+#ifndef __THERMO_MPI_H
+#define __THERMO_MPI_H
+
+#include <cassert>
+#include <mpi.h>
+#include <vector>
+
+// Sums thermodynamic observables over all processes with a single
+// non-blocking reduction per step instead of one blocking reduction per
+// observable. Every observable has a slot: stages set the contributions of
+// their rank, `begin` posts one MPI_Iallreduce over all slots and `finish`
+// waits for it, such that stages in between overlap with the reduction. The
+// kinetic and the potential energy have fixed slots, further observables are
+// added with `add`.
+class ThermoReduction {
+  private:
+    MPI_Comm comm_;
+    // contributions of this rank and sums over all ranks
+    std::vector<double> local_, global_;
+    MPI_Request request_ = MPI_REQUEST_NULL;
+
+  public:
+    static constexpr size_t ekin = 0, epot = 1;
+
+    explicit ThermoReduction(MPI_Comm comm) : comm_(comm), local_(2, 0), global_(2, 0) {}
+    // the request refers to the buffers
+    ThermoReduction(const ThermoReduction &) = delete;
+    ThermoReduction &operator=(const ThermoReduction &) = delete;
+    ~ThermoReduction() {
+        if (pending()) {
+            finish();
+        }
+    }
+
+    // slot of a new observable
+    size_t add() {
+        assert(!pending());
+        local_.push_back(0);
+        global_.push_back(0);
+        return local_.size() - 1;
+    }
+
+    // contribution of this rank to the observable in `slot`
+    void set(size_t slot, double value) {
+        assert(!pending());
+        local_[slot] = value;
+    }
+
+    // post the reduction of all slots
+    void begin() {
+        assert(!pending());
+        MPI_Iallreduce(local_.data(), global_.data(), local_.size(), MPI_DOUBLE, MPI_SUM, comm_, &request_);
+    }
+
+    // wait for the reduction, does nothing if none is pending
+    void finish() { MPI_Wait(&request_, MPI_STATUS_IGNORE); }
+
+    bool pending() const { return request_ != MPI_REQUEST_NULL; }
+
+    // sum of the observable in `slot` over all ranks, once the reduction
+    // finished
+    double get(size_t slot) const {
+        assert(!pending());
+        return global_[slot];
+    }
+};
+
+#endif // __THERMO_MPI_H
@@ -9,8 +9,80 @@ void berendsen_thermostat(Atoms &atoms, double target_temperature, double timest
 
 void berendsen_thermostat(Atoms &atoms, double target_temperature, double timestep,
                           double relaxation_time, double current_temperature) {
-    double lambda =
-        std::sqrt(1 + (target_temperature / current_temperature - 1) *
-                          timestep / relaxation_time);
-    atoms.velocities *= lambda;
+    atoms.velocities *= berendsen_scale(target_temperature, timestep,
+                                        relaxation_time, current_temperature);
+}
+
+double berendsen_scale(double target_temperature, double timestep,
+                       double relaxation_time, double current_temperature) {
+    // atoms at rest cannot be scaled to any temperature
+    if (current_temperature <= 0)
+        return 1;
+    return std::sqrt(1 + (target_temperature / current_temperature - 1) *
+                             timestep / relaxation_time);
+}
+
+void random_velocities(Atoms &atoms, double temperature, uint64_t seed, int nb_local) {
+    double k_B = 8.617333262;
+    Philox philox(seed);
+    for (Eigen::Index i{0}; i < nb_local; ++i) {
+        uint64_t id = atoms.ids(i);
+        // the Langevin thermostat never reaches the step of all ones
+        auto xi{philox.normal({uint32_t(id), ~uint32_t(0), ~uint32_t(0), uint32_t(id >> 32)})};
+        atoms.velocities.col(i) =
+            std::sqrt(k_B * temperature / atoms.masses(i)) * Eigen::Array3d{xi[0], xi[1], xi[2]};
+    }
+}
+
+void LangevinThermostat::step(Atoms &atoms, double timestep, size_t step, int nb_local) const {
+    auto [damping, noise] = coefficients(timestep);
+    for (Eigen::Index i{0}; i < nb_local; ++i) {
+        kick(atoms.velocities.col(i), atoms.masses(i), atoms.ids(i), step, damping, noise);
+    }
+}
+
+// Sum of the squares of `n` standard normal numbers, i.e. twice a gamma
+// distributed number of shape n / 2, drawn with the rejection method of
+// Marsaglia and Tsang, ACM Trans. Math. Softw. 26, 363 (2000). Each attempt
+// uses the next value of counter[2].
+static double sum_of_squares(const Philox &philox, size_t n, Philox::Counter counter) {
+    if (n == 0) {
+        return 0;
+    }
+    if (n == 1) {
+        counter[2]++;
+        double x = philox.normal(counter)[0];
+        return x * x;
+    }
+    double d = n / 2.0 - 1.0 / 3;
+    double c = 1 / std::sqrt(9 * d);
+    while (true) {
+        counter[2]++;
+        double x = philox.normal(counter)[0];
+        double v = std::pow(1 + c * x, 3);
+        if (v <= 0) {
+            continue;
+        }
+        double u = philox.uniform({counter[0], counter[1], counter[2], 1})[0];
+        if (std::log(u) < x * x / 2 + d - d * v + d * std::log(v)) {
+            return 2 * d * v;
+        }
+    }
+}
+
+double BussiThermostat::scale(double ekin, size_t nb_atoms, double timestep, size_t step) const {
+    // atoms at rest cannot be scaled to any temperature
+    if (ekin <= 0)
+        return 1;
+    double k_B = 8.617333262;
+    size_t nb_dof = 3 * nb_atoms;
+    double target_ekin = 0.5 * nb_dof * k_B * target_temperature_;
+    double damping = std::exp(-timestep / relaxation_time_);
+
+    Philox::Counter counter{uint32_t(step), uint32_t(step >> 32), 0, 0};
+    double r1 = philox_.normal(counter)[0];
+    double sum = sum_of_squares(philox_, nb_dof - 1, counter);
+    double new_ekin = ekin + (1 - damping) * (target_ekin * (sum + r1 * r1) / nb_dof - ekin) +
+                      2 * r1 * std::sqrt(ekin * target_ekin / nb_dof * (1 - damping) * damping);
+    return std::sqrt(new_ekin / ekin);
 }
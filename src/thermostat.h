@@ -2,6 +2,9 @@
 #define __THERMOSTAT_H
 
 #include "atoms.h"
+#include "random.h"
+#include <cstdint>
+#include <utility>
 
 // Implementation of the https://en.wikipedia.org/wiki/Berendsen_thermostat.
 void berendsen_thermostat(Atoms &atoms, double target_temperature,
@@ -9,6 +12,81 @@ void berendsen_thermostat(Atoms &atoms, double target_temperature,
 void berendsen_thermostat(Atoms &atoms, double target_temperature,
                           double timestep, double relaxation_time,
                           double current_temperature);
+// Velocity scaling factor of the Berendsen thermostat, e.g. to fold the
+// thermostat into the corrector step of the integrator.
+double berendsen_scale(double target_temperature, double timestep,
+                       double relaxation_time, double current_temperature);
+
+// Thermostats of the initial relaxation, selected with --thermostat
+enum class ThermostatType { Berendsen, Langevin, Bussi };
+
+// Langevin thermostat, integrated exactly over a timestep (the "O" step of the
+// BAOAB splitting, Leimkuhler and Matthews, Appl. Math. Res. Express 2013, 34).
+// The velocities relax towards zero with the relaxation time and receive
+// random kicks of matching strength. The random numbers are keyed on the atom
+// id and the timestep, so the trajectory does not depend on the number of
+// processes or on the order of the atoms.
+class LangevinThermostat {
+  private:
+    double target_temperature_;
+    double relaxation_time_;
+    Philox philox_;
+
+  public:
+    LangevinThermostat(double target_temperature, double relaxation_time, uint64_t seed)
+        : target_temperature_(target_temperature),
+          relaxation_time_(relaxation_time),
+          philox_(seed) {}
+
+    // damping factor of the velocities over `timestep` and the standard
+    // deviation of the random velocity change of an atom of unit mass
+    std::pair<double, double> coefficients(double timestep) const {
+        double k_B = 8.617333262;
+        double damping = std::exp(-timestep / relaxation_time_);
+        return {damping, std::sqrt((1 - damping * damping) * k_B * target_temperature_)};
+    }
+
+    // friction and random kick of a single atom in timestep `step`, with the
+    // coefficients from above
+    template <typename Velocity>
+    void kick(Velocity &&velocity, double mass, int64_t id, size_t step, double damping, double noise) const {
+        auto xi{philox_.normal({uint32_t(id), uint32_t(step), uint32_t(step >> 32), uint32_t(uint64_t(id) >> 32)})};
+        velocity = damping * velocity + noise / std::sqrt(mass) * Eigen::Array3d{xi[0], xi[1], xi[2]};
+    }
+
+    // thermostat the first `nb_local` atoms over `timestep`
+    void step(Atoms &atoms, double timestep, size_t step, int nb_local) const;
+};
+
+// Draw the velocities of the first `nb_local` atoms from the Maxwell-Boltzmann
+// distribution at `temperature` (in 1e-5 K, like Atoms::temperature). As for
+// the Langevin thermostat, the random numbers are keyed on the atom id, so
+// the velocities do not depend on the number of processes or on the order of
+// the atoms.
+void random_velocities(Atoms &atoms, double temperature, uint64_t seed, int nb_local);
+
+// Stochastic velocity rescaling thermostat (Bussi, Donadio and Parrinello,
+// J. Chem. Phys. 126, 014101 (2007)). Like the Berendsen thermostat it scales
+// all velocities by a common factor, but the kinetic energy follows the
+// canonical distribution. The random numbers depend only on the seed and the
+// timestep, so all processes compute the same factor from the global kinetic
+// energy.
+class BussiThermostat {
+  private:
+    double target_temperature_;
+    double relaxation_time_;
+    Philox philox_;
+
+  public:
+    BussiThermostat(double target_temperature, double relaxation_time, uint64_t seed)
+        : target_temperature_(target_temperature),
+          relaxation_time_(relaxation_time),
+          philox_(seed) {}
+
+    // velocity scaling factor for the kinetic energy `ekin` of `nb_atoms`
+    // atoms over `timestep` in timestep `step`
+    double scale(double ekin, size_t nb_atoms, double timestep, size_t step) const;
+};
 
 class ThermostatScheduler {
   private:
@@ -47,12 +125,23 @@ class Equilibrium {
           timestep_(timestep),
           budget_(budget) {}
     
+    // whether the thermostat still acts in `timestep`
+    bool active(size_t timestep) const { return timestep < budget_ / factor_; }
+
     void step(Atoms& atoms, size_t timestep, double temp) {
-        if (timestep < budget_ / factor_) {
+        if (active(timestep)) {
             berendsen_thermostat(atoms, target_temperature_, timestep_,
                                  relaxation_time_, temp);
         }
     }
+    // velocity scaling factor that step applies, 1 once the budget is used up
+    double scale(size_t timestep, double temp) {
+        if (active(timestep)) {
+            return berendsen_scale(target_temperature_, timestep_,
+                                   relaxation_time_, temp);
+        }
+        return 1;
+    }
 };
 
 class EnergyPump {
@@ -0,0 +1,92 @@
+#ifndef __THREAD_POOL_H
+#define __THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that share the iterations of a loop. The
+// calling thread takes part in the work, so a pool of size 1 runs everything
+// on the calling thread.
+class ThreadPool {
+  private:
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    std::function<void(size_t)> task_;
+    size_t nb_tasks_ = 0;
+    std::atomic<size_t> next_task_{0};
+    size_t nb_busy_ = 0;
+    size_t generation_ = 0;
+    bool stop_ = false;
+
+    // hand out loop iterations until none are left
+    void run_tasks() {
+        for (size_t i = next_task_++; i < nb_tasks_; i = next_task_++) {
+            task_(i);
+        }
+    }
+
+    void work() {
+        size_t generation = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            start_.wait(lock, [&] { return stop_ || generation_ != generation; });
+            if (stop_) {
+                return;
+            }
+            generation = generation_;
+            lock.unlock();
+            run_tasks();
+            lock.lock();
+            if (--nb_busy_ == 0) {
+                done_.notify_all();
+            }
+        }
+    }
+
+  public:
+    ThreadPool(size_t nb_threads) {
+        for (size_t i = 1; i < nb_threads; i++) {
+            workers_.emplace_back(&ThreadPool::work, this);
+        }
+    }
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        start_.notify_all();
+        for (auto &worker : workers_) {
+            worker.join();
+        }
+    }
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // number of threads including the calling thread
+    size_t size() const { return workers_.size() + 1; }
+
+    // call task(i) for all i in [0, n) and return once all calls are done;
+    // iterations are handed out dynamically in increasing order of i
+    void parallel_for(size_t n, std::function<void(size_t)> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            task_ = std::move(task);
+            nb_tasks_ = n;
+            next_task_ = 0;
+            nb_busy_ = workers_.size();
+            generation_++;
+        }
+        start_.notify_all();
+        run_tasks();
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [&] { return nb_busy_ == 0; });
+    }
+};
+
+#endif // __THREAD_POOL_H
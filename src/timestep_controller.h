@@ -0,0 +1,126 @@
+#ifndef __TIMESTEP_CONTROLLER_H
+#define __TIMESTEP_CONTROLLER_H
+
+#include "atoms.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// Adapts the timestep of the integrator to the state of the system. The
+// timestep shrinks right away once an atom moves farther than allowed in one
+// step or the measured energy drift exceeds its limit. It grows slowly if the
+// fastest atom and the largest force over a window of steps would permit a
+// larger timestep, so it does not follow every fluctuation.
+class TimestepController {
+  private:
+    double timestep_;
+    double min_timestep_;
+    double max_timestep_;
+    double max_displacement_;
+    double max_drift_;
+    size_t window_;
+    double growth_ = 1.1;
+    // largest velocity and acceleration within the current window
+    double max_velocity_ = 0;
+    double max_acceleration_ = 0;
+    size_t nb_steps_ = 0;
+    // upper bound from the measured energy drift
+    double drift_limit_ = INFINITY;
+    // total energy and time of the last drift measurement
+    double energy_ = NAN;
+    double time_ = 0;
+    double elapsed_ = 0;
+    std::string reason_;
+
+    bool set_timestep(double timestep, const std::string &reason) {
+        max_velocity_ = 0;
+        max_acceleration_ = 0;
+        nb_steps_ = 0;
+        timestep = std::clamp(timestep, min_timestep_, max_timestep_);
+        if (timestep == timestep_) {
+            return false;
+        }
+        timestep_ = timestep;
+        reason_ = reason;
+        return true;
+    }
+
+  public:
+    // `max_displacement` limits how far any atom moves in one step; with a
+    // neighbor list skin it should stay well below half of the skin, such that
+    // the list remains valid for several steps. `max_drift` limits the energy
+    // drift per atom and femtosecond. The timestep grows at most once per
+    // `window` steps.
+    TimestepController(double timestep, double min_timestep, double max_timestep, double max_displacement,
+                       double max_drift, size_t window = 100)
+        : timestep_(timestep),
+          min_timestep_(min_timestep),
+          max_timestep_(max_timestep),
+          max_displacement_(max_displacement),
+          max_drift_(max_drift),
+          window_(window) {}
+
+    double timestep() const { return timestep_; }
+    // the limit that caused the last change of the timestep
+    const std::string &reason() const { return reason_; }
+
+    // Account for a step with the largest displacement `max_displacement` of
+    // any atom and the resulting forces on the atoms. Returns whether the
+    // timestep changed.
+    bool update(const Atoms &atoms, double max_displacement) {
+        elapsed_ += timestep_;
+        if (max_displacement > max_displacement_) {
+            // the displacement grows about linearly with the timestep; leave
+            // some room, such that the timestep does not grow right away
+            return set_timestep(timestep_ * max_displacement_ / (growth_ * max_displacement), "displacement");
+        }
+
+        max_velocity_ = std::max(max_velocity_, max_displacement / timestep_);
+        max_acceleration_ =
+            std::max(max_acceleration_, (atoms.forces.colwise().norm().transpose() / atoms.masses).maxCoeff());
+        if (++nb_steps_ < window_) {
+            return false;
+        }
+
+        // the displacement due to the force alone grows quadratically with
+        // the timestep
+        double velocity_limit{max_velocity_ > 0 ? max_displacement_ / max_velocity_ : max_timestep_};
+        double force_limit{max_acceleration_ > 0 ? std::sqrt(2 * max_displacement_ / max_acceleration_)
+                                                 : max_timestep_};
+        double target{std::min({velocity_limit, force_limit, drift_limit_})};
+        if (target > growth_ * timestep_) {
+            return set_timestep(growth_ * timestep_, "growth");
+        }
+        if (target < timestep_) {
+            return set_timestep(target, target == force_limit ? "force" : target == drift_limit_ ? "drift"
+                                                                                              : "displacement");
+        }
+        return set_timestep(timestep_, reason_);
+    }
+
+    // Measure the energy drift per atom and femtosecond since the last call,
+    // not counting `energy_added` by e.g. a thermostat or an energy pump in
+    // the meantime. Shrinks the timestep and caps its growth if the drift
+    // exceeds its limit, the cap is lifted gradually while the drift stays
+    // well below. Returns whether the timestep changed.
+    bool update_drift(double total_energy, double energy_added, size_t nb_atoms) {
+        double energy{energy_};
+        double time{elapsed_ - time_};
+        energy_ = total_energy;
+        time_ = elapsed_;
+        if (std::isnan(energy) || time <= 0) {
+            return false;
+        }
+        double drift{std::abs(total_energy - energy - energy_added) / (nb_atoms * time)};
+        if (drift > max_drift_) {
+            drift_limit_ = timestep_ / (growth_ * growth_);
+            return set_timestep(drift_limit_, "drift");
+        }
+        if (drift < max_drift_ / 4) {
+            drift_limit_ *= growth_;
+        }
+        return false;
+    }
+};
+
+#endif // __TIMESTEP_CONTROLLER_H
@@ -2,6 +2,7 @@
 #define __TYPES_H
 
 #include <Eigen/Dense>
+#include <cstdint>
 #include <vector>
 
 using Positions_t = Eigen::Array3Xd;
@@ -9,5 +10,20 @@ using Velocities_t = Eigen::Array3Xd;
 using Forces_t = Eigen::Array3Xd;
 using Masses_t = Eigen::ArrayXd;
 using Names_t = std::vector<std::string>;
+using Ids_t = Eigen::Array<int64_t, Eigen::Dynamic, 1>;
+
+// Views of the per-atom vectors held by Atoms. By default the coordinates of
+// each atom are adjacent (x0 y0 z0 x1 y1 z1 ...). With USE_SOA every
+// coordinate is a separate array (x0 x1 ... y0 y1 ... z0 z1 ...) that starts
+// on a cache line, such that kernels can load consecutive atoms with SIMD
+// instructions.
+#ifdef USE_SOA
+using Vectors_t = Eigen::Map<Eigen::Array3Xd, Eigen::Aligned64, Eigen::Stride<1, Eigen::Dynamic>>;
+#else
+using Vectors_t = Eigen::Map<Eigen::Array3Xd>;
+#endif
+// references that bind to these views as well as to plain arrays
+using VectorsRef_t = Eigen::Ref<Eigen::Array3Xd, 0, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>>;
+using ConstVectorsRef_t = Eigen::Ref<const Eigen::Array3Xd, 0, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>>;
 
 #endif  // __TYPES_H
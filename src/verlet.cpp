@@ -1,4 +1,6 @@
 #include "verlet.h"
+#include <algorithm>
+#include <cmath>
 
 void verlet_step1(double &x, double &y, double &z, double &vx, double &vy, double &vz,
                   double fx, double fy, double fz, double timestep, double mass) {
@@ -17,20 +19,103 @@ void verlet_step2(double &vx, double &vy, double &vz, double fx, double fy, doub
     vz += fz * timestep / (2 * mass);
 }
 
-void verlet_step1(Positions_t &positions, Velocities_t &velocities,
-                  const Forces_t &forces, double timestep, double mass) {
+void verlet_step1(VectorsRef_t positions, VectorsRef_t velocities,
+                  const ConstVectorsRef_t &forces, double timestep, double mass) {
     velocities += forces * timestep / (2 * mass);
     positions += velocities * timestep;
 }
 
-void verlet_step2(Velocities_t &velocities, const Forces_t &forces, double timestep, double mass) {
+void verlet_step2(VectorsRef_t velocities, const ConstVectorsRef_t &forces, double timestep, double mass) {
     velocities += forces * timestep / (2 * mass);
 }
 
-void verlet_step1(Atoms &atoms, double timestep) {
-    atoms.velocities += atoms.forces * timestep / (2 * atoms.get_mass());
-    atoms.positions += atoms.velocities * timestep;
+double verlet_step1(Atoms &atoms, double timestep) {
+#ifdef USE_SOA
+    // every coordinate is a contiguous row of its own
+    if (atoms.nb_atoms() == 0)
+        return 0;
+    for (int d = 0; d < 3; d++) {
+        atoms.velocities.row(d) += atoms.forces.row(d) * timestep / (2 * atoms.masses.transpose());
+        atoms.positions.row(d) += atoms.velocities.row(d) * timestep;
+    }
+    return std::sqrt((atoms.velocities * timestep).square().colwise().sum().maxCoeff());
+#else
+    double max_displacement_sq{0};
+    for (Eigen::Index i{0}; i < atoms.positions.cols(); ++i) {
+        auto &&v{atoms.velocities.col(i)};
+        v += atoms.forces.col(i) * (timestep / (2 * atoms.masses(i)));
+        Eigen::Array3d displacement{v * timestep};
+        atoms.positions.col(i) += displacement;
+        max_displacement_sq = std::max(max_displacement_sq, displacement.square().sum());
+    }
+    return std::sqrt(max_displacement_sq);
+#endif
 }
-void verlet_step2(Atoms &atoms, double timestep) {
-    atoms.velocities += atoms.forces * timestep / (2 * atoms.get_mass());
+
+double verlet_step2(Atoms &atoms, double timestep) {
+    return verlet_step2(atoms, timestep, 1, atoms.nb_atoms());
+}
+
+double verlet_step2(Atoms &atoms, double timestep, double velocity_scale, int nb_local) {
+#ifdef USE_SOA
+    for (int d = 0; d < 3; d++) {
+        atoms.velocities.row(d) = (atoms.velocities.row(d) +
+                                   atoms.forces.row(d) * timestep / (2 * atoms.masses.transpose())) *
+                                  velocity_scale;
+    }
+    return (atoms.masses.head(nb_local).transpose() *
+            atoms.velocities.leftCols(nb_local).square().colwise().sum())
+               .sum() /
+           2;
+#else
+    double ekin{0};
+    for (Eigen::Index i{0}; i < atoms.velocities.cols(); ++i) {
+        auto &&v{atoms.velocities.col(i)};
+        v = (v + atoms.forces.col(i) * (timestep / (2 * atoms.masses(i)))) * velocity_scale;
+        if (i < nb_local)
+            ekin += atoms.masses(i) * v.square().sum();
+    }
+    return ekin / 2;
+#endif
+}
+
+double verlet_step2(Atoms &atoms, double timestep, const LangevinThermostat &thermostat, size_t step,
+                    int nb_local) {
+    auto [damping, noise] = thermostat.coefficients(timestep);
+    double ekin{0};
+    for (Eigen::Index i{0}; i < atoms.velocities.cols(); ++i) {
+        auto &&v{atoms.velocities.col(i)};
+        v += atoms.forces.col(i) * (timestep / (2 * atoms.masses(i)));
+        if (i < nb_local) {
+            thermostat.kick(v, atoms.masses(i), atoms.ids(i), step, damping, noise);
+            ekin += atoms.masses(i) * v.square().sum();
+        }
+    }
+    return ekin / 2;
+}
+
+void verlet_kick(Atoms &atoms, const Forces_t &forces, double timestep) {
+    for (Eigen::Index i{0}; i < atoms.velocities.cols(); ++i) {
+        atoms.velocities.col(i) += forces.col(i) * (timestep / (2 * atoms.masses(i)));
+    }
+}
+
+double respa_step(Atoms &atoms, Forces_t &slow_forces, double timestep, size_t nb_inner,
+                  const std::function<void(double)> &fast_forces, const std::function<void()> &compute_slow_forces) {
+    double outer_timestep = nb_inner * timestep;
+    double displacement{0};
+    verlet_kick(atoms, slow_forces, outer_timestep);
+    for (size_t k = 0; k < nb_inner; k++) {
+        double max_displacement = verlet_step1(atoms, timestep);
+        displacement += max_displacement;
+        fast_forces(max_displacement);
+        verlet_step2(atoms, timestep);
+    }
+    // evaluate the slow forces into the slow buffer, keeping the fast forces
+    // for the first inner step of the next call
+    atoms.forces.swap(slow_forces);
+    compute_slow_forces();
+    atoms.forces.swap(slow_forces);
+    verlet_kick(atoms, slow_forces, outer_timestep);
+    return displacement;
 }
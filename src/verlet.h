@@ -2,7 +2,9 @@
 #define __VERLET_H
 
 #include "atoms.h"
+#include "thermostat.h"
 #include "types.h"
+#include <functional>
 
 // predictor step of the velocity verlet integrator (https://en.wikipedia.org/wiki/Verlet_integration#Velocity_Verlet), implemented manually
 void verlet_step1(double &x, double &y, double &z, double &vx, double &vy, double &vz,
@@ -11,14 +13,45 @@ void verlet_step1(double &x, double &y, double &z, double &vx, double &vy, doubl
 void verlet_step2(double &vx, double &vy, double &vz, double fx, double fy, double fz,
                   double timestep, double mass=1);
 // predictor step of the velocity verlet integrator (https://en.wikipedia.org/wiki/Verlet_integration#Velocity_Verlet), implemented with Eigen
-void verlet_step1(Positions_t &positions, Velocities_t &velocities,
-                  const Forces_t &forces, double timestep, double mass=1);
+void verlet_step1(VectorsRef_t positions, VectorsRef_t velocities,
+                  const ConstVectorsRef_t &forces, double timestep, double mass=1);
 // corrector step of the velocity verlet integrator (https://en.wikipedia.org/wiki/Verlet_integration#Velocity_Verlet), implemented with Eigen
-void verlet_step2(Velocities_t &velocities, const Forces_t &forces, double timestep, double mass=1);
+void verlet_step2(VectorsRef_t velocities, const ConstVectorsRef_t &forces, double timestep, double mass=1);
 
-// predictor step of the velocity verlet integrator (https://en.wikipedia.org/wiki/Verlet_integration#Velocity_Verlet), implemented with Eigen
-void verlet_step1(Atoms &atoms, double timestep);
-// corrector step of the velocity verlet integrator (https://en.wikipedia.org/wiki/Verlet_integration#Velocity_Verlet), implemented with Eigen
-void verlet_step2(Atoms &atoms, double timestep);
+// predictor step of the velocity verlet integrator (https://en.wikipedia.org/wiki/Verlet_integration#Velocity_Verlet)
+// with per-atom masses, fused into a single pass over the atoms; returns the
+// largest displacement of any atom, e.g. to decide when to rebuild the neighbor
+// list
+double verlet_step1(Atoms &atoms, double timestep);
+// corrector step of the velocity verlet integrator (https://en.wikipedia.org/wiki/Verlet_integration#Velocity_Verlet)
+// with per-atom masses, fused into a single pass over the atoms; returns the
+// kinetic energy of all atoms
+double verlet_step2(Atoms &atoms, double timestep);
+// corrector step that also scales the velocities by `velocity_scale` (e.g. a
+// thermostat) and returns the kinetic energy of the first `nb_local` atoms
+double verlet_step2(Atoms &atoms, double timestep, double velocity_scale, int nb_local);
+// corrector step followed by the Langevin `thermostat` over the full timestep
+// `step` of the first `nb_local` atoms in the same pass; returns their kinetic
+// energy
+double verlet_step2(Atoms &atoms, double timestep, const LangevinThermostat &thermostat, size_t step,
+                    int nb_local);
+// half step update of the velocities by `forces`, e.g. the slow forces of the
+// multiple timestep integrator below
+void verlet_kick(Atoms &atoms, const Forces_t &forces, double timestep);
+
+// One step of the reversible multiple timestep integrator r-RESPA (Tuckerman,
+// Berne, Martyna, J. Chem. Phys. 97, 1990 (1992)). The slow forces kick the
+// velocities at the beginning and end of the step, in between `nb_inner`
+// velocity verlet steps of length `timestep` integrate the fast forces. The
+// step thus advances the time by `nb_inner * timestep`.
+//
+// `fast_forces(max_displacement)` is called after each inner drift with the
+// largest displacement of that drift and computes the fast forces into
+// `atoms.forces`. `compute_slow_forces()` is called once at the end and also
+// computes into `atoms.forces`; the result is kept in `slow_forces` for the
+// next step, so it has to be initialized before the first step. Returns the
+// largest accumulated displacement of any atom.
+double respa_step(Atoms &atoms, Forces_t &slow_forces, double timestep, size_t nb_inner,
+                  const std::function<void(double)> &fast_forces, const std::function<void()> &compute_slow_forces);
 
 #endif  // __VERLET_H
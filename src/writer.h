@@ -5,6 +5,7 @@
 #include <argparse/argparse.hpp>
 #include <filesystem>
 #include <iostream>
+#include <sstream>
 
 namespace fs = std::filesystem;
 
@@ -20,10 +21,36 @@ class Writer {
     size_t output_interval;
     std::ofstream csv;
     std::ofstream traj;
+    std::string name;
+
+    // appends the name of the simulation to the stem of a file name
+    fs::path with_name(const fs::path &path) {
+        if (name.empty()) {
+            return path;
+        }
+        return path.parent_path() / (path.stem().string() + "_" + name + path.extension().string());
+    }
+
+    // console prefix of simulations running side by side
+    std::string prefix() {
+        return name.empty() ? "" : name + ": ";
+    }
 
   public:
     Writer() = default;
-    Writer(fs::path pwd, argparse::ArgumentParser parser) {
+    Writer(fs::path pwd, argparse::ArgumentParser parser) : Writer(pwd, parser, "") {}
+    // Writer that only prints to the console and opens no files, e.g. for a
+    // driver whose simulations write their own csv and xyz files.
+    Writer(argparse::ArgumentParser parser)
+        : write_to_csv(false),
+          write_to_xyz(false),
+          write_to_console(!parser.get<bool>("--silent")),
+          verbose(parser.get<bool>("--verbose")),
+          output_interval(parser.get<size_t>("--output_interval")) {}
+    // Writer for one of several simulations running side by side, output files
+    // get the name of the simulation appended and console output is prefixed
+    // with it.
+    Writer(fs::path pwd, argparse::ArgumentParser parser, std::string simulation_name) : name(simulation_name) {
         write_to_csv = parser.is_used("--csv");
         write_to_xyz = parser.is_used("--traj");
         write_to_console = !parser.get<bool>("--silent");
@@ -38,6 +65,7 @@ class Writer {
                 std::cout << "No csv path provided, using default path: "
                           << csv_path << std::endl;
             }
+            csv_path = with_name(csv_path);
 
             csv.open(csv_path);
             csv << "Timestep,Total Energy,Kinetic Energy,Potential Energy,Temperature,Stress,Strain"
@@ -52,6 +80,7 @@ class Writer {
                 std::cout << "No traj path provided, using default path: "
                           << csv_path << std::endl;
             }
+            traj_path = with_name(traj_path);
 
             traj.open(traj_path);
         }
@@ -64,13 +93,17 @@ class Writer {
     void write_stats(size_t timestep, double ekin, double epot, double temp = 0, double stress = 0, double strain = 0) {
         if (timestep % output_interval == 0) {
             if (write_to_console) {
-                std::cout << "Frame: " << (int)(timestep / output_interval) << " ";
-                std::cout << "Total Energy: " << ekin + epot << ", ";
-                std::cout << "Kinetic Energy: " << ekin << ", ";
-                std::cout << "Potential Energy: " << epot << ", ";
-                std::cout << "Temperature: " << temp << ", ";
-                std::cout << "Stress: " << stress << ", ";
-                std::cout << "Strain: " << strain << std::endl;
+                // assemble the line first, such that simulations running side
+                // by side do not interleave their output
+                std::ostringstream line;
+                line << prefix() << "Frame: " << (int)(timestep / output_interval) << " ";
+                line << "Total Energy: " << ekin + epot << ", ";
+                line << "Kinetic Energy: " << ekin << ", ";
+                line << "Potential Energy: " << epot << ", ";
+                line << "Temperature: " << temp << ", ";
+                line << "Stress: " << stress << ", ";
+                line << "Strain: " << strain << std::endl;
+                std::cout << line.str();
             }
             if (write_to_csv) {
                 csv << timestep << "," << ekin + epot << "," << ekin << "," << epot << "," << temp << "," << stress << "," << strain << std::endl;
@@ -86,14 +119,16 @@ class Writer {
     // print some info to console
     void log(std::string msg) {
         if (write_to_console) {
-            std::cout << msg << std::endl;
+            std::cout << prefix() + msg + "\n" << std::flush;
         }
     }
     // print some info to console with an additional value
     template<typename T>
     void log(std::string msg, T value) {
         if (write_to_console) {
-            std::cout << msg << value << std::endl;
+            std::ostringstream line;
+            line << prefix() << msg << value << std::endl;
+            std::cout << line.str();
         }
     }
     // print some debug info to console
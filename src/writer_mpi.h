@@ -4,6 +4,7 @@
 #include "mpi_support.h"
 #include "writer.h"
 #include "xyz.h"
+#include "xyz_mpi.h"
 #include <argparse/argparse.hpp>
 #include <filesystem>
 #include <iostream>
@@ -12,24 +13,58 @@
 namespace fs = std::filesystem;
 
 // Handles writing simulation data in various formats such as console, csv and xyz. Can also deal with multiple processes.
+// Trajectories and checkpoints are written collectively with MPI-IO, every
+// process writes the block of its own atoms, see write_xyz_at_all.
 class MPIWriter : public Writer {
 private:
     int thread_id;
+    MPI_File traj_file;
+    // end of the last frame in the trajectory
+    MPI_Offset traj_offset = 0;
+    bool write_checkpoint_;
+    fs::path checkpoint_path;
 public:
     MPIWriter(fs::path pwd, argparse::ArgumentParser parser) : Writer(pwd, parser) {
         thread_id = MPI::comm_rank(MPI_COMM_WORLD);
+        if (write_to_xyz) {
+            // the trajectory is shared by all processes
+            traj.close();
+            MPI_File_open(MPI_COMM_WORLD, traj_path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+                          &traj_file);
+            MPI_File_set_size(traj_file, 0);
+        }
+        write_checkpoint_ = parser.is_used("--checkpoint");
+        if (write_checkpoint_) {
+            try {
+                checkpoint_path = fs::path(parser.get<std::string>("--checkpoint"));
+            } catch (const std::logic_error &e) {
+                checkpoint_path = pwd / "checkpoint.xyz";
+            }
+        }
+    }
+    ~MPIWriter() {
+        if (write_to_xyz) {
+            MPI_File_close(&traj_file);
+        }
     }
-    ~MPIWriter() {}
     // write stats to console/csv in given intervals in main thread
     void write_stats(size_t timestep, double ekin, double epot, double temp = 0, double stress = 0, double strain = 0) {
         if (thread_id == 0) {
             Writer::write_stats(timestep, ekin, epot, temp, stress, strain);
         }
     }
-    // write simulation state to xyz file in given intervals in main thread
-    void write_traj(size_t timestep, Atoms& atoms) {
-        if (thread_id == 0) {
-            Writer::write_traj(timestep, atoms);
+    // write the first nb_local atoms of all processes as a frame of the
+    // trajectory in given intervals, collective
+    void write_traj(size_t timestep, const Atoms& atoms, size_t nb_local) {
+        if (write_to_xyz && timestep % output_interval == 0) {
+            traj_offset += write_xyz_at_all(traj_file, traj_offset, atoms, nb_local, MPI_COMM_WORLD);
+        }
+    }
+    // write the first nb_local atoms of all processes with full precision,
+    // e.g. at the end of a simulation, collective
+    void write_checkpoint(const Atoms& atoms, size_t nb_local) {
+        if (write_checkpoint_) {
+            write_xyz_all(checkpoint_path, atoms, nb_local, MPI_COMM_WORLD);
         }
     }
     // print some info to console in main thread
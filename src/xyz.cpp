@@ -111,8 +111,8 @@ void write_xyz(std::ofstream &file, Atoms &atoms) {
 
     // Element name, position
     for (size_t i = 0; i < atoms.nb_atoms(); ++i) {
-        auto w = atoms.names[i].length();
-        file << std::setw(w)  << atoms.names[i] << " "
+        auto w = atoms.name(i).length();
+        file << std::setw(w)  << atoms.name(i) << " "
              << std::setw(10) << atoms.positions.col(i).transpose()
              << std::setw(10) << atoms.velocities.col(i).transpose()
              << std::endl;
@@ -0,0 +1,238 @@
+#include "xyz_mpi.h"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+MPI_Offset write_xyz_at_all(MPI_File file, MPI_Offset offset, const Atoms &atoms, size_t nb_local,
+                            MPI_Comm comm, int precision) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    // All ranks agree on the widths of the columns: the longest name and the
+    // digits of the largest id.
+    long long widths[2]{0, 0};
+    for (size_t i = 0; i < nb_local; ++i) {
+        widths[0] = std::max<long long>(widths[0], atoms.name(i).size());
+        widths[1] = std::max<long long>(widths[1], atoms.ids(i));
+    }
+    MPI_Allreduce(MPI_IN_PLACE, widths, 2, MPI_LONG_LONG, MPI_MAX, comm);
+    int name_width = widths[0], id_width = std::to_string(widths[1]).size();
+    // sign, leading digit, point, digits and an exponent of up to three digits
+    int number_width = precision + 8;
+    size_t line_width = name_width + 6 * (number_width + 1) + id_width + 2;
+
+    // Index of the first atom of this rank and number of atoms of all ranks.
+    long long nb = nb_local, first = 0, nb_atoms = 0;
+    MPI_Exscan(&nb, &first, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0) {
+        // MPI_Exscan leaves the result on the first rank undefined.
+        first = 0;
+    }
+    MPI_Allreduce(&nb, &nb_atoms, 1, MPI_LONG_LONG, MPI_SUM, comm);
+
+    // The first rank writes the header in front of its atoms.
+    std::string header{std::to_string(nb_atoms) + "\nProperties=species:S:1:pos:R:3:velo:R:3:id:I:1\n"};
+    std::string buffer{rank == 0 ? header : ""};
+    size_t start{buffer.size()};
+    buffer.resize(start + nb_local * line_width);
+    if (buffer.size() > INT_MAX) {
+        throw std::runtime_error("Frame is too large to be written by a single rank");
+    }
+
+    // snprintf needs room for the terminating null character.
+    std::vector<char> line(line_width + 1);
+    for (size_t i = 0; i < nb_local; ++i) {
+        auto &&r{atoms.positions.col(i)};
+        auto &&v{atoms.velocities.col(i)};
+        std::snprintf(line.data(), line.size(), "%-*s % *.*e % *.*e % *.*e % *.*e % *.*e % *.*e %*lld\n",
+                      name_width, atoms.name(i).c_str(), number_width, precision, r(0), number_width, precision,
+                      r(1), number_width, precision, r(2), number_width, precision, v(0), number_width, precision,
+                      v(1), number_width, precision, v(2), id_width, static_cast<long long>(atoms.ids(i)));
+        std::copy_n(line.begin(), line_width, buffer.begin() + start + i * line_width);
+    }
+
+    MPI_Offset position{rank == 0 ? offset : offset + MPI_Offset(header.size() + first * line_width)};
+    MPI_File_write_at_all(file, position, buffer.data(), buffer.size(), MPI_CHAR, MPI_STATUS_IGNORE);
+
+    return header.size() + nb_atoms * line_width;
+}
+
+void write_xyz_all(const std::string &filename, const Atoms &atoms, size_t nb_local, MPI_Comm comm,
+                   int precision) {
+    MPI_File file;
+    if (MPI_File_open(comm, filename.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) !=
+        MPI_SUCCESS) {
+        throw std::runtime_error("Could not open file");
+    }
+    // Drop what a longer file held before.
+    MPI_File_set_size(file, 0);
+    write_xyz_at_all(file, 0, atoms, nb_local, comm, precision);
+    MPI_File_close(&file);
+}
+
+/*
+ * Read up to `size` bytes from `offset` on, independently of other ranks.
+ */
+static std::string read_at(MPI_File file, MPI_Offset offset, MPI_Offset size) {
+    MPI_Offset file_size;
+    MPI_File_get_size(file, &file_size);
+    std::string text(std::max<MPI_Offset>(0, std::min(size, file_size - offset)), '\0');
+    // MPI counts are ints
+    constexpr MPI_Offset max_count{1 << 30};
+    for (MPI_Offset done = 0; done < MPI_Offset(text.size()); done += max_count) {
+        int count = std::min<MPI_Offset>(max_count, text.size() - done);
+        MPI_File_read_at(file, offset + done, text.data() + done, count, MPI_CHAR, MPI_STATUS_IGNORE);
+    }
+    return text;
+}
+
+Atoms read_xyz_all(const std::string &filename, MPI_Comm comm, bool with_velocities) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    MPI_File file;
+    if (MPI_File_open(comm, filename.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        throw std::runtime_error("Could not open file");
+    }
+    MPI_Offset file_size;
+    MPI_File_get_size(file, &file_size);
+
+    // The first rank reads the header: the number of atoms and a comment
+    // line. It tells the others where the lines of the atoms begin and
+    // whether the comment line declares a column of ids.
+    long long header[3]{0, 0, 0};
+    if (rank == 0) {
+        std::string text;
+        size_t first_newline{std::string::npos}, second_newline{std::string::npos};
+        while (second_newline == std::string::npos && MPI_Offset(text.size()) < file_size) {
+            text += read_at(file, text.size(), 4096);
+            first_newline = text.find('\n');
+            if (first_newline != std::string::npos) {
+                second_newline = text.find('\n', first_newline + 1);
+            }
+        }
+        header[0] = second_newline == std::string::npos ? file_size : second_newline + 1;
+        std::istringstream(text.substr(0, first_newline)) >> header[1];
+        if (first_newline != std::string::npos) {
+            header[2] = text.substr(first_newline + 1, header[0] - first_newline - 1).find("id:I:1") !=
+                        std::string::npos;
+        }
+    }
+    MPI_Bcast(header, 3, MPI_LONG_LONG, 0, comm);
+    MPI_Offset body{header[0]};
+    long long nb_atoms{header[1]};
+    bool with_ids{with_velocities && header[2]};
+
+    // Every rank owns the lines that start within its part of the bytes. It
+    // reads one byte in front, which tells whether a line starts right at
+    // its first byte, and as much beyond its part as it takes to complete
+    // its last line.
+    MPI_Offset chunk{(file_size - body + size - 1) / size};
+    MPI_Offset begin{std::min(file_size, body + rank * chunk)}, end{std::min(file_size, begin + chunk)};
+    std::string text;
+    if (begin < end) {
+        text = read_at(file, begin - 1, end - begin + 1);
+        while (MPI_Offset(begin - 1 + text.size()) < file_size &&
+               text.find('\n', end - begin) == std::string::npos) {
+            text += read_at(file, begin - 1 + text.size(), 4096);
+        }
+    }
+    MPI_File_close(&file);
+
+    // Parse the lines that start within the part of this rank, i.e. before
+    // relative position `bound`.
+    std::vector<std::string> names;
+    std::vector<double> values;
+    std::vector<long long> ids;
+    size_t bound = end - begin + 1, start = text.find('\n');
+    while (start != std::string::npos && start + 1 < bound) {
+        size_t stop{text.find('\n', start + 1)};
+        std::istringstream line(text.substr(start + 1, stop == std::string::npos ? stop : stop - start - 1));
+        std::string name;
+        double r[6]{0, 0, 0, 0, 0, 0};
+        long long id{0};
+        if (line >> name >> r[0] >> r[1] >> r[2]) {
+            if (with_velocities) {
+                line >> r[3] >> r[4] >> r[5];
+            }
+            if (with_ids && !(line >> id)) {
+                throw std::runtime_error("Line of an atom lacks its id");
+            }
+            names.push_back(name);
+            values.insert(values.end(), r, r + 6);
+            ids.push_back(id);
+        }
+        start = stop;
+    }
+
+    // Without a column of ids, atoms are numbered in the order of the file;
+    // lines beyond the number in the header are ignored.
+    long long nb_lines = names.size(), first = 0;
+    MPI_Exscan(&nb_lines, &first, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0) {
+        first = 0;
+    }
+    long long nb_read = std::max(0LL, std::min(nb_lines, nb_atoms - first));
+    long long nb_total;
+    MPI_Allreduce(&nb_read, &nb_total, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (nb_total < nb_atoms) {
+        throw std::runtime_error("File holds fewer atoms than its header says");
+    }
+
+    Eigen::Map<Eigen::Array<double, 6, Eigen::Dynamic>> columns(values.data(), 6, nb_read);
+    Atoms atoms(Positions_t{columns.topRows(3)}, Velocities_t{columns.bottomRows(3)});
+    if (with_ids) {
+        for (long long i = 0; i < nb_read; i++) {
+            atoms.ids(i) = ids[i];
+        }
+    } else {
+        atoms.ids = Ids_t::LinSpaced(nb_read, first, first + nb_read - 1);
+    }
+
+    // All ranks learn the names of all atoms as runs, see NameRuns. Every
+    // rank walks its ids in increasing order and starts a run where the name
+    // changes or where it lacks the previous id, which another rank holds.
+    std::vector<long long> order(nb_read);
+    for (long long i = 0; i < nb_read; i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](long long a, long long b) { return atoms.ids(a) < atoms.ids(b); });
+    std::string local_runs;
+    for (long long k = 0; k < nb_read; k++) {
+        long long i{order[k]};
+        if (k == 0 || atoms.ids(i) != atoms.ids(order[k - 1]) + 1 || names[i] != names[order[k - 1]]) {
+            local_runs += std::to_string(atoms.ids(i)) + " " + names[i] + "\n";
+        }
+    }
+    int length = local_runs.size();
+    std::vector<int> lengths(size), displs(size, 0);
+    MPI_Allgather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, comm);
+    for (int i = 1; i < size; i++) {
+        displs[i] = displs[i - 1] + lengths[i - 1];
+    }
+    std::string all_runs(displs[size - 1] + lengths[size - 1], '\0');
+    MPI_Allgatherv(local_runs.data(), length, MPI_CHAR, all_runs.data(), lengths.data(), displs.data(), MPI_CHAR,
+                   comm);
+    // The runs of the ranks interleave when the ids are not in the order of
+    // the file. The constructor named all atoms alike, the runs replace these
+    // names.
+    std::vector<std::pair<int64_t, std::string>> starts;
+    std::istringstream stream(all_runs);
+    int64_t id;
+    std::string name;
+    while (stream >> id >> name) {
+        starts.emplace_back(id, name);
+    }
+    std::sort(starts.begin(), starts.end());
+    NameRuns all_names;
+    for (auto &&run : starts) {
+        all_names.append(run.first, run.second);
+    }
+    atoms.names = std::move(all_names);
+    return atoms;
+}
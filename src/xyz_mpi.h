@@ -0,0 +1,44 @@
+#ifndef __XYZ_MPI_H
+#define __XYZ_MPI_H
+
+#include "atoms.h"
+#include <mpi.h>
+#include <string>
+
+/*
+ * Collectively write the first `nb_local` atoms of every rank of `comm` as one
+ * frame of an extended XYZ file, starting at byte `offset` of `file`:
+ *     line 1: Number of atoms
+ *     line 2: Properties=species:S:1:pos:R:3:velo:R:3:id:I:1
+ *     following lines: Name X Y Z VX VY VZ ID
+ * The atoms of each rank follow those of the lower ranks, read_xyz_all
+ * restores their ids. All lines have the same width, so every rank knows
+ * where its block starts from the number of atoms on the lower ranks and
+ * writes it with a single MPI_File_write_at_all. Numbers are written with
+ * `precision` significant digits after the decimal point. Returns the size of
+ * the frame in bytes, the same on all ranks.
+ */
+MPI_Offset write_xyz_at_all(MPI_File file, MPI_Offset offset, const Atoms &atoms, size_t nb_local,
+                            MPI_Comm comm, int precision = 6);
+
+/*
+ * Collectively write a single frame as above to the file `filename`, e.g. a
+ * checkpoint with full precision that read_xyz_all reads back.
+ */
+void write_xyz_all(const std::string &filename, const Atoms &atoms, size_t nb_local, MPI_Comm comm,
+                   int precision = 17);
+
+/*
+ * Collectively read an XYZ file, where every rank reads and parses a disjoint
+ * part of the lines. Lines hold Name X Y Z, followed by VX VY VZ if
+ * `with_velocities` is set, e.g. as written by write_xyz_all. Returns the
+ * atoms whose lines start within the byte range of this rank. Their ids are
+ * read from the column that follows the velocities if the comment line
+ * declares id:I:1, as write_xyz_all does, and must then number the atoms
+ * without gaps; otherwise they number the atoms in the order of the file.
+ * The names of all atoms are known on all ranks. Use Domain::distribute to
+ * send the atoms to their subdomains.
+ */
+Atoms read_xyz_all(const std::string &filename, MPI_Comm comm, bool with_velocities = false);
+
+#endif // __XYZ_MPI_H
@@ -0,0 +1,12 @@
+#include <gtest/gtest.h>
+#include <mpi.h>
+
+// The tests of the MPI code run on a single process, MPI is initialized once
+// for all of them.
+class MPIEnvironment : public ::testing::Environment {
+  public:
+    void SetUp() override { MPI_Init(nullptr, nullptr); }
+    void TearDown() override { MPI_Finalize(); }
+};
+
+static auto *const mpi_environment{::testing::AddGlobalTestEnvironment(new MPIEnvironment)};
@@ -0,0 +1,40 @@
+#include "aligned_allocator.h"
+#include "atoms.h"
+#include "neighbors.h"
+#include <gtest/gtest.h>
+
+TEST(AlignedAllocatorTest, AlignsArrays) {
+    std::vector<double, AlignedAllocator<double, 256>> small(3);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(small.data()) % 256, 0);
+
+    // arrays of at least a huge page start on a huge page
+    using HugePageAllocator = AlignedAllocator<double, 64, true>;
+    std::vector<double, HugePageAllocator> large(HugePageAllocator::huge_page_size / sizeof(double) + 1);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(large.data()) % HugePageAllocator::huge_page_size, 0);
+
+    Atoms atoms(10);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(atoms.positions.data()) % ATOMS_ALIGNMENT, 0);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(atoms.masses.data()) % ATOMS_ALIGNMENT, 0);
+}
+
+TEST(AlignedAllocatorTest, NeighborListKeepsItsStorage) {
+    Positions_t positions(3, 3);
+    positions << 0, 1, 5,
+                 0, 0, 0,
+                 0, 0, 0;
+    Atoms atoms(positions);
+    NeighborList neighbor_list(1.5);
+    neighbor_list.update(atoms);
+    const int *data = std::get<1>(neighbor_list.neighbors()).data();
+
+    // fewer pairs fit into the storage of the last update
+    atoms.positions(0, 1) = 3;
+    auto [seed, neighbors]{neighbor_list.update(atoms)};
+    EXPECT_EQ(neighbors.size(), 0);
+    EXPECT_EQ(neighbors.data(), data);
+
+    // copies view their own storage
+    NeighborList copy{neighbor_list};
+    EXPECT_NE(std::get<0>(copy.neighbors()).data(), seed.data());
+    EXPECT_EQ(std::get<0>(copy.neighbors()).size(), 4);
+}
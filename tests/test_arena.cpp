@@ -0,0 +1,41 @@
+#include "arena.h"
+#include <gtest/gtest.h>
+
+TEST(ArenaTest, AlignsAllocations) {
+    Arena arena;
+    Arena::Scope scope{arena};
+    auto a{arena.map<Eigen::ArrayXd>(3)};
+    auto b{arena.map<Eigen::Array3Xf>(3, 5)};
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(a.data()) % Arena::alignment, 0);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(b.data()) % Arena::alignment, 0);
+    EXPECT_NE(a.data(), nullptr);
+    EXPECT_EQ(b.rows(), 3);
+    EXPECT_EQ(b.cols(), 5);
+    EXPECT_EQ(arena.used(), 2 * Arena::alignment);
+}
+
+TEST(ArenaTest, ReusesMemoryAfterTheOutermostScope) {
+    Arena arena(128);
+    {
+        Arena::Scope step{arena};
+        arena.allocate(100);
+        {
+            // a nested scope keeps its memory until the step ends
+            Arena::Scope kernel{arena};
+            arena.allocate(1000);
+        }
+        EXPECT_EQ(arena.used(), 128 + 1024);
+    }
+    EXPECT_EQ(arena.used(), 0);
+    EXPECT_EQ(arena.peak(), 128 + 1024);
+
+    // the blocks were merged, a step of the same size fits without growing
+    size_t capacity = arena.capacity();
+    EXPECT_GE(capacity, arena.peak());
+    {
+        Arena::Scope step{arena};
+        auto *first = static_cast<unsigned char *>(arena.allocate(100));
+        EXPECT_EQ(arena.allocate(1000), first + 128);
+        EXPECT_EQ(arena.capacity(), capacity);
+    }
+}
@@ -0,0 +1,88 @@
+#include "atoms.h"
+#include <gtest/gtest.h>
+
+TEST(AtomsTest, ResizeKeepsAtoms) {
+    Atoms atoms(10);
+    atoms.positions.setRandom();
+    atoms.set_mass(2);
+    Positions_t positions{atoms.positions};
+
+    atoms.resize(4);
+    EXPECT_EQ(atoms.nb_atoms(), 4);
+    EXPECT_EQ(atoms.positions.cols(), 4);
+    EXPECT_EQ(atoms.capacity(), 10);
+
+    // growing within the capacity neither moves nor changes the atoms
+    const double *data = atoms.positions.data();
+    atoms.resize(8);
+    EXPECT_EQ(atoms.positions.data(), data);
+    EXPECT_TRUE(atoms.positions.leftCols(4).isApprox(positions.leftCols(4)));
+    EXPECT_TRUE((atoms.masses == 2).all());
+
+    atoms.resize(100);
+    EXPECT_GE(atoms.capacity(), 100);
+    EXPECT_EQ(atoms.velocities.cols(), 100);
+    EXPECT_TRUE(atoms.positions.leftCols(4).isApprox(positions.leftCols(4)));
+    EXPECT_EQ(atoms.ids(3), 3);
+}
+
+TEST(AtomsTest, CopyOwnsItsData) {
+    Atoms atoms(5);
+    atoms.positions.setRandom();
+    Atoms copy{atoms};
+    EXPECT_NE(copy.positions.data(), atoms.positions.data());
+    EXPECT_TRUE(copy.positions.isApprox(atoms.positions));
+
+    copy.positions.setZero();
+    EXPECT_FALSE(atoms.positions.isZero());
+
+    atoms = copy;
+    EXPECT_NE(copy.positions.data(), atoms.positions.data());
+    EXPECT_TRUE(atoms.positions.isZero());
+}
+
+TEST(AtomsTest, ReserveKeepsCoordinates) {
+    Atoms atoms(7);
+    atoms.positions.setRandom();
+    Positions_t positions{atoms.positions};
+
+    atoms.reserve(50);
+    EXPECT_GE(atoms.capacity(), 50);
+    EXPECT_TRUE(atoms.positions.isApprox(positions));
+#ifdef USE_SOA
+    // every coordinate starts on a cache line
+    for (int d = 0; d < 3; d++) {
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(atoms.positions.row(d).data()) % 64, 0);
+    }
+#endif
+}
+
+TEST(AtomsTest, SortById) {
+    Names_t names{"Au", "Ag", "Cu"};
+    Positions_t positions(3, 3);
+    positions << 0, 1, 2,
+                 0, 0, 0,
+                 0, 0, 0;
+    Atoms atoms(names, positions);
+    atoms.ids << 2, 0, 1;
+    EXPECT_EQ(atoms.name(0), "Cu");
+
+    atoms.sort_by_id();
+    EXPECT_TRUE((atoms.ids == Ids_t::LinSpaced(3, 0, 2)).all());
+    EXPECT_TRUE((atoms.positions.row(0) == Eigen::Array3d{1, 2, 0}.transpose()).all());
+    EXPECT_EQ(atoms.name(0), "Au");
+}
+
+TEST(AtomsTest, NameRuns) {
+    NameRuns names(Names_t{"Au", "Au", "Ag", "Ag", "Ag", "Au"});
+    EXPECT_EQ(names.nb_runs(), 3);
+    EXPECT_EQ(names[1], "Au");
+    EXPECT_EQ(names[2], "Ag");
+    EXPECT_EQ(names[4], "Ag");
+    EXPECT_EQ(names[5], "Au");
+
+    // the last run covers all further ids
+    names.append(8, "Cu");
+    EXPECT_EQ(names[7], "Au");
+    EXPECT_EQ(names[100], "Cu");
+}
@@ -0,0 +1,42 @@
+#include "decomposition.h"
+#include <gtest/gtest.h>
+
+TEST(DecompositionTest, Estimate) {
+    // 1000 atoms fill a periodic cube of 10, split into halves along z
+    Eigen::Array3d length{10, 10, 10};
+    auto estimate{estimate_decomposition({1, 1, 2}, 1000, {0, 0, 0}, length, length, {1, 1, 1}, 1)};
+    EXPECT_NEAR(estimate.atoms, 12 * 12 * 7, 1e-9);
+    EXPECT_NEAR(estimate.imbalance, 1, 1e-12);
+
+    // without periodicity there are no ghosts beyond the atoms
+    estimate = estimate_decomposition({1, 1, 2}, 1000, {0, 0, 0}, length, length, {0, 0, 0}, 1);
+    EXPECT_NEAR(estimate.atoms, 600, 1e-9);
+    EXPECT_NEAR(estimate.imbalance, 1, 1e-12);
+
+    // atoms in the lower half of z leave the upper subdomain empty
+    estimate = estimate_decomposition({1, 1, 2}, 1000, {0, 0, 0}, {10, 10, 5}, length, {0, 0, 0}, 1);
+    EXPECT_NEAR(estimate.atoms, 1000, 1e-9);
+    EXPECT_NEAR(estimate.imbalance, 2, 1e-12);
+}
+
+TEST(DecompositionTest, Choose) {
+    // a wire along z is cut across its axis
+    Eigen::Array3d wire{10, 10, 200};
+    auto choice{choose_decomposition(4, 1e4, {0, 0, 0}, wire, wire, {0, 0, 1}, 5)};
+    EXPECT_EQ(choice.decomposition.matrix(), Eigen::Vector3i(1, 1, 4));
+
+    // a slab in the x-y plane is cut within the plane
+    Eigen::Array3d slab{100, 100, 10};
+    choice = choose_decomposition(4, 1e4, {0, 0, 0}, slab, slab, {1, 1, 0}, 5);
+    EXPECT_EQ(choice.decomposition.matrix(), Eigen::Vector3i(2, 2, 1));
+
+    // a cube splits into cubes
+    Eigen::Array3d cube{30, 30, 30};
+    choice = choose_decomposition(8, 1e4, {0, 0, 0}, cube, cube, {1, 1, 1}, 3);
+    EXPECT_EQ(choice.decomposition.matrix(), Eigen::Vector3i(2, 2, 2));
+
+    // a prime number of processes leaves only one direction to split
+    choice = choose_decomposition(7, 1e4, {0, 0, 0}, cube, cube, {1, 1, 1}, 3);
+    EXPECT_EQ(choice.decomposition.matrix(), Eigen::Vector3i(1, 1, 7));
+    EXPECT_NEAR(choice.imbalance, 1, 1e-12);
+}
@@ -0,0 +1,20 @@
+#include "domain.h"
+#include <gtest/gtest.h>
+
+TEST(DomainTest, DistributeWrapsPositions) {
+    Atoms atoms(3);
+    atoms.positions << -1, 11, 5,
+                       2, 3, -4,
+                       25, -0.5, 1e-17;
+    Domain domain(MPI_COMM_WORLD, {10, 10, 10}, {1, 1, 1}, {1, 0, 1});
+    domain.distribute(atoms);
+
+    ASSERT_EQ(domain.nb_local(), 3);
+    // periodic along x and z, not along y
+    Positions_t positions(3, 3);
+    positions << 9, 1, 5,
+                 2, 3, -4,
+                 5, 9.5, 1e-17;
+    EXPECT_TRUE(atoms.positions.isApprox(positions, 1e-12));
+    EXPECT_TRUE((atoms.positions.row(0) >= 0).all() && (atoms.positions.row(0) < 10).all());
+}
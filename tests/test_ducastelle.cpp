@@ -24,9 +24,11 @@
 
 #include <gtest/gtest.h>
 
+#include "arena.h"
 #include "atoms.h"
 #include "ducastelle.h"
 #include "neighbors.h"
+#include "omp_support.h"
 
 TEST(DucastelleTest, Forces) {
     constexpr int nx = 2, ny = 2, nz = 2;
@@ -81,3 +83,180 @@ TEST(DucastelleTest, Forces) {
         }
     }
 }
+
+TEST(DucastelleTest, MixedPrecision) {
+    constexpr int nx = 4, ny = 4, nz = 4;
+    constexpr double lattice_constant = 2.885;
+    constexpr double cutoff = 7.0;
+
+    NeighborList neighbor_list(cutoff);
+
+    Atoms atoms(nx * ny * nz);
+
+    // simple cubic lattice with random displacements, shifted away from the
+    // origin to check that single precision positions are taken relative
+    atoms.positions.setRandom();
+    atoms.positions *= 0.1;
+    for (size_t x{0}, i{0}; x < nx; ++x) {
+        for (size_t y{0}; y < ny; ++y) {
+            for (size_t z{0}; z < nz; ++z, ++i) {
+                atoms.positions(0, i) += x * lattice_constant + 1000;
+                atoms.positions(1, i) += y * lattice_constant;
+                atoms.positions(2, i) += z * lattice_constant;
+            }
+        }
+    }
+
+    neighbor_list.update(atoms);
+    double e_double{ducastelle(atoms, neighbor_list, atoms.nb_atoms(), PotentialOptions{Precision::Double}, cutoff)};
+    Forces_t f_double{atoms.forces};
+    double e_mixed{ducastelle(atoms, neighbor_list, atoms.nb_atoms(), PotentialOptions{Precision::Mixed}, cutoff)};
+    Forces_t f_mixed{atoms.forces};
+
+    EXPECT_NEAR(e_mixed, e_double, 1e-5 * std::abs(e_double));
+    EXPECT_NEAR((f_mixed - f_double).abs().maxCoeff(), 0, 1e-4);
+}
+
+TEST(DucastelleTest, ForcesWithoutEnergy) {
+    constexpr double cutoff = 5.0;
+
+    NeighborList neighbor_list(cutoff);
+
+    Atoms atoms(8);
+    atoms.positions.setRandom();
+    atoms.positions *= 3.0;
+
+    neighbor_list.update(atoms);
+    PotentialOptions options;
+    double e{ducastelle(atoms, neighbor_list, atoms.nb_atoms(), options, cutoff)};
+    Forces_t forces{atoms.forces};
+    options.energy = false;
+    double e_skipped{ducastelle(atoms, neighbor_list, atoms.nb_atoms(), options, cutoff)};
+
+    EXPECT_NE(e, 0);
+    EXPECT_EQ(e_skipped, 0);
+    EXPECT_TRUE((atoms.forces == forces).all());
+}
+
+TEST(DucastelleTest, SplitPhases) {
+    constexpr double cutoff = 5.0;
+
+    NeighborList neighbor_list(cutoff);
+
+    Atoms atoms(27);
+    atoms.positions.setRandom();
+    atoms.positions *= 4.0;
+
+    neighbor_list.update(atoms);
+    PotentialOptions options;
+    double e{ducastelle(atoms, neighbor_list, atoms.nb_atoms(), options, cutoff)};
+    Forces_t forces{atoms.forces};
+
+    auto density{ducastelle_density(atoms, neighbor_list, atoms.nb_atoms(), options, cutoff)};
+    double e_split{ducastelle_forces(atoms, neighbor_list, density, atoms.nb_atoms(), options, cutoff)};
+
+    EXPECT_DOUBLE_EQ(e_split, e);
+    EXPECT_TRUE((atoms.forces == forces).all());
+}
+
+TEST(DucastelleTest, Phases) {
+    constexpr double cutoff = 5.0;
+    constexpr double lattice_constant = 2.5;
+    constexpr size_t nx = 6, ny = 3, nz = 3;
+    constexpr int nb_local = 3 * ny * nz;
+
+    NeighborList neighbor_list(cutoff);
+
+    // slabs of a simple cubic lattice along x with random displacements, the
+    // upper half plays the role of ghosts
+    Atoms atoms(nx * ny * nz);
+    atoms.positions.setRandom();
+    atoms.positions *= 0.1;
+    for (size_t x{0}, i{0}; x < nx; ++x) {
+        for (size_t y{0}; y < ny; ++y) {
+            for (size_t z{0}; z < nz; ++z, ++i) {
+                atoms.positions(0, i) += x * lattice_constant;
+                atoms.positions(1, i) += y * lattice_constant;
+                atoms.positions(2, i) += z * lattice_constant;
+            }
+        }
+    }
+
+    neighbor_list.update(atoms);
+    PotentialOptions options;
+    double e{ducastelle(atoms, neighbor_list, nb_local, options, cutoff)};
+    Forces_t forces{atoms.forces};
+
+    std::vector<int> interior, boundary;
+    neighbor_list.split(nb_local, nb_local, interior, boundary);
+    Eigen::Map<Eigen::ArrayXi> interior_indices(interior.data(), interior.size()),
+        boundary_indices(boundary.data(), boundary.size());
+    auto ghost_density{ducastelle_density(atoms, neighbor_list, atoms.nb_atoms(), options, cutoff)};
+
+    Arena::Scope scope{step_arena()};
+    DucastellePhases eam(atoms, neighbor_list, nb_local, options, cutoff);
+    eam.density(interior_indices);
+    eam.ghost_positions();
+    eam.density(boundary_indices);
+    atoms.forces.setZero();
+    double e_phases{eam.forces(interior_indices)};
+    eam.densities().tail(atoms.nb_atoms() - nb_local) = ghost_density.tail(atoms.nb_atoms() - nb_local);
+    eam.ghost_densities();
+    e_phases += eam.forces(boundary_indices);
+
+    EXPECT_FALSE(interior.empty());
+    EXPECT_FALSE(boundary.empty());
+    EXPECT_NEAR(e_phases, e, 1e-12 * std::abs(e));
+    EXPECT_TRUE((atoms.forces == forces).all());
+}
+
+TEST(DucastelleTest, ForceTerms) {
+    constexpr double cutoff = 5.0;
+
+    NeighborList neighbor_list(cutoff);
+
+    Atoms atoms(8);
+    atoms.positions.setRandom();
+    atoms.positions *= 3.0;
+
+    neighbor_list.update(atoms);
+    PotentialOptions options;
+    double e{ducastelle(atoms, neighbor_list, atoms.nb_atoms(), options, cutoff)};
+    Forces_t forces{atoms.forces};
+    options.terms = ForceTerms::Repulsive;
+    double e_repulsive{ducastelle(atoms, neighbor_list, atoms.nb_atoms(), options, cutoff)};
+    Forces_t repulsive_forces{atoms.forces};
+    options.terms = ForceTerms::Embedding;
+    double e_embedding{ducastelle(atoms, neighbor_list, atoms.nb_atoms(), options, cutoff)};
+
+    // the terms add up to the full potential
+    EXPECT_GT(e_repulsive, 0);
+    EXPECT_LT(e_embedding, 0);
+    EXPECT_NEAR(e_repulsive + e_embedding, e, 1e-12);
+    EXPECT_TRUE((repulsive_forces + atoms.forces).isApprox(forces));
+}
+
+TEST(DucastelleTest, Threads) {
+    constexpr double cutoff = 5.0;
+
+    NeighborList neighbor_list(cutoff);
+
+    Atoms atoms(100);
+    atoms.positions.setRandom();
+    atoms.positions *= 8.0;
+
+    neighbor_list.update(atoms);
+    PotentialOptions options;
+    int nb_threads{OMP::max_threads()};
+    OMP::set_threads(1);
+    double e{ducastelle(atoms, neighbor_list, atoms.nb_atoms(), options, cutoff)};
+    Forces_t forces{atoms.forces};
+    OMP::set_threads(4);
+    double e_threads{ducastelle(atoms, neighbor_list, atoms.nb_atoms(), options, cutoff)};
+    OMP::set_threads(nb_threads);
+
+    // every atom sums its own forces, only the energy is summed in another
+    // order
+    EXPECT_NEAR(e_threads, e, 1e-12 * std::abs(e));
+    EXPECT_TRUE((atoms.forces == forces).all());
+}
@@ -0,0 +1,69 @@
+#include "atoms.h"
+#include "ducastelle.h"
+#include "lj_direct_summation.h"
+#include "minimizer.h"
+#include "neighbors.h"
+#include <gtest/gtest.h>
+
+TEST(MinimizerTest, LennardJonesDimer) {
+    double epsilon = 1, sigma = 1;
+    Positions_t positions(3, 2);
+    positions << 0, 1.5,
+                 0, 0,
+                 0, 0;
+    Atoms atoms(positions);
+
+    auto compute_forces = [&](double) {
+        lj_direct_summation(atoms, epsilon, sigma);
+        return int(atoms.nb_atoms());
+    };
+    FireParameters parameters;
+    parameters.fmax = 1e-6;
+    parameters.timestep = 0.01;
+    parameters.max_timestep = 0.1;
+    auto result = fire_minimize(atoms, compute_forces, parameters);
+
+    // the minimum of the pair potential is at 2^(1/6) sigma
+    EXPECT_TRUE(result.converged);
+    EXPECT_LE(result.fmax, 1e-6);
+    double distance = (atoms.positions.col(1) - atoms.positions.col(0)).matrix().norm();
+    EXPECT_NEAR(distance, std::pow(2, 1.0 / 6) * sigma, 1e-6);
+    EXPECT_TRUE((atoms.velocities == 0).all());
+}
+
+TEST(MinimizerTest, DucastelleCluster) {
+    constexpr double cutoff = 5.0;
+    NeighborList neighbor_list(cutoff);
+
+    // perturbed fcc cube of gold
+    constexpr int n = 3;
+    constexpr double lattice_constant = 4.079;
+    Positions_t positions(3, 4 * n * n * n);
+    Eigen::Array<double, 3, 4> basis;
+    basis << 0, 0.5, 0.5, 0,
+             0, 0.5, 0, 0.5,
+             0, 0, 0.5, 0.5;
+    int k = 0;
+    for (int x = 0; x < n; x++)
+        for (int y = 0; y < n; y++)
+            for (int z = 0; z < n; z++)
+                for (int b = 0; b < 4; b++)
+                    positions.col(k++) = (basis.col(b) + Eigen::Array3d{double(x), double(y), double(z)}) *
+                                         lattice_constant;
+    positions += 0.1 * Positions_t::Random(3, positions.cols());
+    Atoms atoms(positions);
+    atoms.set_mass(197 * 103.6);
+
+    double epot = 0;
+    auto compute_forces = [&](double) {
+        neighbor_list.update(atoms);
+        epot = ducastelle(atoms, neighbor_list, cutoff);
+        return int(atoms.nb_atoms());
+    };
+    compute_forces(0);
+    double epot_start = epot;
+    auto result = fire_minimize(atoms, compute_forces);
+
+    EXPECT_TRUE(result.converged);
+    EXPECT_LT(epot, epot_start);
+}
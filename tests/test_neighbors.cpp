@@ -24,6 +24,7 @@
 
 #include "atoms.h"
 #include "neighbors.h"
+#include "omp_support.h"
 #include "xyz.h"
 
 #include <gtest/gtest.h>
@@ -141,3 +142,72 @@ TEST(NeighborsTest, AtomsHaveNoNeighbors) {
 }
 
 
+
+TEST(NeighborsTest, Skin) {
+    Names_t names{{"H", "H", "H"}};
+    Positions_t positions(3, 3);
+    positions << 0, 1, 1.8,
+                 0, 0, 0,
+                 0, 0, 0;
+
+    Atoms atoms(names, positions);
+    NeighborList neighbor_list(1.5, 0.5);
+    EXPECT_TRUE(neighbor_list.is_stale(0));
+    neighbor_list.update(atoms);
+
+    // atoms 0 and 2 are outside of the cutoff but within the skin
+    EXPECT_EQ(neighbor_list.nb_neighbors(), 6);
+
+    // the list stays valid while atoms moved by less than half the skin
+    EXPECT_FALSE(neighbor_list.is_stale(0.1));
+    EXPECT_FALSE(neighbor_list.is_stale(0.1));
+    EXPECT_TRUE(neighbor_list.is_stale(0.1));
+    neighbor_list.update(atoms);
+    EXPECT_FALSE(neighbor_list.is_stale(0.2));
+
+    // without a skin the list is always stale
+    NeighborList plain_list(1.5);
+    EXPECT_TRUE(plain_list.is_stale(0));
+}
+
+TEST(NeighborsTest, Split) {
+    // a chain of four atoms, the last one is a ghost
+    Names_t names{{"H", "H", "H", "H"}};
+    Positions_t positions(3, 4);
+    positions << 0, 1, 2.1, 3.2,
+                 0, 0, 0, 0,
+                 0, 0, 0, 0;
+
+    Atoms atoms(names, positions);
+    NeighborList neighbor_list(1.5);
+    neighbor_list.update(atoms);
+
+    std::vector<int> interior, boundary;
+    neighbor_list.split(3, 3, interior, boundary);
+    EXPECT_EQ(interior, (std::vector<int>{0, 1}));
+    EXPECT_EQ(boundary, (std::vector<int>{2}));
+
+    // with forces on ghosts, those are boundary atoms as well
+    neighbor_list.split(3, 4, interior, boundary);
+    EXPECT_EQ(interior, (std::vector<int>{0, 1}));
+    EXPECT_EQ(boundary, (std::vector<int>{2, 3}));
+}
+
+TEST(NeighborsTest, Threads) {
+    Atoms atoms(200);
+    atoms.positions.setRandom();
+    atoms.positions *= 5.0;
+
+    // the list is the same for any number of threads
+    int nb_threads{OMP::max_threads()};
+    OMP::set_threads(1);
+    NeighborList serial_list(2.0);
+    auto [serial_seed, serial_neighbors]{serial_list.update(atoms)};
+    OMP::set_threads(4);
+    NeighborList threaded_list(2.0);
+    auto [seed, neighbors]{threaded_list.update(atoms)};
+    OMP::set_threads(nb_threads);
+
+    EXPECT_TRUE((seed == serial_seed).all());
+    EXPECT_TRUE((neighbors == serial_neighbors).all());
+}
@@ -0,0 +1,27 @@
+#include "random.h"
+#include <gtest/gtest.h>
+
+// known answers from the reference implementation (Random123)
+TEST(RandomTest, PhiloxKnownAnswers) {
+    Philox zero(0);
+    Philox::Counter expected{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8};
+    EXPECT_EQ(zero({0, 0, 0, 0}), expected);
+
+    Philox ones(0xffffffffffffffff);
+    expected = {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd};
+    EXPECT_EQ(ones({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}), expected);
+}
+
+TEST(RandomTest, NormalMoments) {
+    Philox philox(42);
+    constexpr uint32_t nb_draws = 100000;
+    double sum = 0, sum_sq = 0;
+    for (uint32_t i = 0; i < nb_draws; i++) {
+        for (double x : philox.normal({i, 0, 0, 0})) {
+            sum += x;
+            sum_sq += x * x;
+        }
+    }
+    EXPECT_NEAR(sum / (4 * nb_draws), 0, 0.01);
+    EXPECT_NEAR(sum_sq / (4 * nb_draws), 1, 0.01);
+}
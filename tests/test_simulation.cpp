@@ -0,0 +1,54 @@
+#include "simulation.h"
+#include <gtest/gtest.h>
+
+TEST(SimulationTest, StageOrder) {
+    Simulation simulation(1, 0);
+    std::vector<std::string> calls;
+    auto stage = [&](const std::string &name) { return [&calls, name](Step &) { calls.push_back(name); }; };
+    simulation.add("a", stage("a"));
+    simulation.add("c", stage("c"));
+    simulation.insert_before("c", "b", stage("b"));
+    simulation.insert_after("c", "d", stage("d"));
+    simulation.move_before("d", "a");
+    simulation.replace("c", stage("C"));
+    simulation.remove("b");
+    EXPECT_EQ(simulation.stages(), (std::vector<std::string>{"d", "a", "c"}));
+    EXPECT_THROW(simulation.remove("b"), std::runtime_error);
+
+    simulation.run(0, 1);
+    EXPECT_EQ(calls, (std::vector<std::string>{"d", "a", "C"}));
+}
+
+TEST(SimulationTest, Schedules) {
+    Simulation simulation(0.5, 4);
+    std::vector<size_t> every, scheduled, output;
+    simulation.add("every", [&](Step &step) { every.push_back(step.ts); });
+    simulation.add("scheduled", [&](Step &step) { scheduled.push_back(step.ts); }, Schedule{3, 2, 9});
+    simulation.add("output", [&](Step &step) {
+        if (step.output) {
+            output.push_back(step.ts);
+        }
+    });
+    simulation.add("never", [&](Step &) { FAIL(); }, Schedule{0});
+    Step last = simulation.run(0, 10);
+
+    EXPECT_EQ(every.size(), 10);
+    EXPECT_EQ(scheduled, (std::vector<size_t>{2, 5, 8}));
+    EXPECT_EQ(output, (std::vector<size_t>{0, 4, 8}));
+    EXPECT_EQ(last.ts, 9);
+    EXPECT_EQ(last.timestep, 0.5);
+    auto timings = simulation.timings();
+    EXPECT_EQ(timings[1].name, "scheduled");
+    EXPECT_EQ(timings[1].calls, 3);
+    EXPECT_EQ(timings[3].calls, 0);
+}
+
+TEST(SimulationTest, KineticEnergyOfPreviousStep) {
+    Simulation simulation(1, 0);
+    std::vector<double> previous;
+    simulation.add("thermostat", [&](Step &step) { previous.push_back(step.ekin); });
+    simulation.add("verlet2", [](Step &step) { step.ekin = step.ts + 1; });
+    simulation.run(0, 2);
+    simulation.run(2, 3);
+    EXPECT_EQ(previous, (std::vector<double>{0, 1, 2}));
+}
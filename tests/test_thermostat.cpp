@@ -38,3 +38,54 @@ TEST(ThermostatTest, Simulate) {
     }
     EXPECT_NEAR(atoms.current_temperature(), target_temperaure, 0.01);
 }
+
+TEST(ThermostatTest, Langevin) {
+    constexpr int nb_atoms = 1000;
+    double timestep = 1;
+    double target_temperature = 3;
+
+    Atoms atoms(nb_atoms);
+    atoms.velocities.setRandom();
+    LangevinThermostat thermostat(target_temperature, 10 * timestep, 42);
+    double temperature = 0;
+    for (size_t i = 0; i < 2000; i++) {
+        verlet_step2(atoms, timestep, thermostat, i, nb_atoms);
+        if (i >= 1000) {
+            temperature += atoms.current_temperature() / 1000;
+        }
+    }
+    EXPECT_NEAR(temperature, target_temperature, 0.01 * target_temperature);
+}
+
+TEST(ThermostatTest, Bussi) {
+    constexpr int nb_atoms = 100;
+    double timestep = 1;
+    double target_temperature = 3;
+
+    Atoms atoms(nb_atoms);
+    atoms.velocities.setRandom();
+    BussiThermostat thermostat(target_temperature, 10 * timestep, 42);
+    double temperature = 0;
+    for (size_t i = 0; i < 20000; i++) {
+        atoms.velocities *= thermostat.scale(atoms.kinetic_energy(), nb_atoms, timestep, i);
+        if (i >= 10000) {
+            temperature += atoms.current_temperature() / 10000;
+        }
+    }
+    EXPECT_NEAR(temperature, target_temperature, 0.02 * target_temperature);
+}
+
+TEST(ThermostatTest, RandomVelocities) {
+    constexpr int nb_atoms = 10000;
+    double target_temperature = 3;
+
+    Atoms atoms(nb_atoms);
+    random_velocities(atoms, target_temperature, 42, nb_atoms);
+    EXPECT_NEAR(atoms.current_temperature(), target_temperature, 0.03 * target_temperature);
+
+    // the velocities follow the atoms, not their order
+    Atoms reversed(nb_atoms);
+    reversed.ids.reverseInPlace();
+    random_velocities(reversed, target_temperature, 42, nb_atoms);
+    EXPECT_TRUE((reversed.velocities.rowwise().reverse() == atoms.velocities).all());
+}
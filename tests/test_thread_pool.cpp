@@ -0,0 +1,26 @@
+#include "thread_pool.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(ThreadPoolTest, EachTaskRunsOnce) {
+    ThreadPool pool(4);
+    EXPECT_EQ(pool.size(), 4);
+    std::vector<int> counts(1000, 0);
+    // reuse the pool for several loops
+    for (int round = 0; round < 10; round++) {
+        pool.parallel_for(counts.size(), [&](size_t i) { counts[i]++; });
+    }
+    for (auto count : counts) {
+        EXPECT_EQ(count, 10);
+    }
+}
+
+TEST(ThreadPoolTest, SingleThread) {
+    ThreadPool pool(1);
+    EXPECT_EQ(pool.size(), 1);
+    size_t sum = 0;
+    pool.parallel_for(100, [&](size_t i) { sum += i; });
+    EXPECT_EQ(sum, 4950);
+    pool.parallel_for(0, [&](size_t) { sum = 0; });
+    EXPECT_EQ(sum, 4950);
+}
@@ -0,0 +1,45 @@
+#include "atoms.h"
+#include "timestep_controller.h"
+#include <gtest/gtest.h>
+
+TEST(TimestepControllerTest, GrowsAndShrinks) {
+    Atoms atoms(4);
+    TimestepController controller(1.0, 0.5, 2.0, 0.1, 1e-3, 10);
+
+    // slow atoms without forces let the timestep grow once per window
+    for (int i = 0; i < 9; i++) {
+        EXPECT_FALSE(controller.update(atoms, 0.01));
+    }
+    EXPECT_TRUE(controller.update(atoms, 0.01));
+    EXPECT_DOUBLE_EQ(controller.timestep(), 1.1);
+    EXPECT_EQ(controller.reason(), "growth");
+
+    // an atom that moves too far shrinks it right away
+    EXPECT_TRUE(controller.update(atoms, 0.2));
+    EXPECT_LT(controller.timestep(), 0.55 + 1e-12);
+    EXPECT_EQ(controller.reason(), "displacement");
+
+    // but never below the lower limit
+    EXPECT_DOUBLE_EQ(controller.timestep(), 0.5);
+}
+
+TEST(TimestepControllerTest, Drift) {
+    Atoms atoms(4);
+    TimestepController controller(1.0, 0.1, 2.0, 0.1, 1e-3, 100);
+
+    for (int i = 0; i < 5; i++) {
+        controller.update(atoms, 0.01);
+    }
+    EXPECT_FALSE(controller.update_drift(-10.0, 0, atoms.nb_atoms()));
+    for (int i = 0; i < 5; i++) {
+        controller.update(atoms, 0.01);
+    }
+    // energy added from the outside does not count as drift
+    EXPECT_FALSE(controller.update_drift(-9.0, 1.0, atoms.nb_atoms()));
+    for (int i = 0; i < 5; i++) {
+        controller.update(atoms, 0.01);
+    }
+    EXPECT_TRUE(controller.update_drift(-8.0, 0, atoms.nb_atoms()));
+    EXPECT_EQ(controller.reason(), "drift");
+    EXPECT_NEAR(controller.timestep(), 1.0 / (1.1 * 1.1), 1e-12);
+}
@@ -62,3 +62,70 @@ TEST(VerletTest, Eigen) {
     auto energy_after = energies_after.sum();
     EXPECT_NEAR(energy_after, energy_before, 1e-3);
 }
+
+TEST(VerletTest, FusedPerAtomMasses) {
+    double timestep = 1e-2;
+    size_t nb_atoms = 10;
+    Atoms atoms(nb_atoms);
+    atoms.positions.setRandom();
+    atoms.velocities.setRandom();
+    atoms.forces.setRandom();
+    atoms.masses.setLinSpaced(1, 2);
+    Positions_t positions{atoms.positions};
+    Velocities_t velocities{atoms.velocities};
+
+    // reference: plain velocity verlet with per-atom masses
+    Eigen::Array<double, 1, Eigen::Dynamic> inverse_masses{atoms.masses.inverse().transpose()};
+    velocities += (atoms.forces.rowwise() * inverse_masses) * timestep / 2;
+    Positions_t displacements{velocities * timestep};
+    positions += displacements;
+    velocities += (atoms.forces.rowwise() * inverse_masses) * timestep / 2;
+    double lambda = 1.1;
+    velocities *= lambda;
+
+    double max_displacement = verlet_step1(atoms, timestep);
+    double ekin = verlet_step2(atoms, timestep, lambda, 4);
+    EXPECT_NEAR(max_displacement, displacements.colwise().norm().maxCoeff(), 1e-12);
+    EXPECT_TRUE(atoms.positions.isApprox(positions));
+    EXPECT_TRUE(atoms.velocities.isApprox(velocities));
+    double ekin_ref = (velocities.leftCols(4).colwise().squaredNorm() * atoms.masses.head(4).transpose()).sum() / 2;
+    EXPECT_NEAR(ekin, ekin_ref, 1e-12);
+}
+
+TEST(VerletTest, Respa) {
+    double timestep = 1e-2;
+    size_t nb_inner = 4;
+    double k_fast = 100, k_slow = 1;
+
+    // harmonic oscillators with a stiff and a soft spring
+    Atoms atoms(5);
+    atoms.positions.setRandom();
+    auto fast_forces = [&](double) { atoms.forces = -k_fast * atoms.positions; };
+    auto slow_forces = [&]() { atoms.forces = -k_slow * atoms.positions; };
+    auto energy = [&]() {
+        return atoms.kinetic_energy() + (k_fast + k_slow) * atoms.positions.square().sum() / 2;
+    };
+
+    Forces_t slow{-k_slow * atoms.positions};
+    fast_forces(0);
+    double energy_before = energy();
+    for (int i = 0; i < 1000; i++) {
+        respa_step(atoms, slow, timestep, nb_inner, fast_forces, slow_forces);
+    }
+    EXPECT_TRUE(slow.isApprox(-k_slow * atoms.positions));
+    EXPECT_TRUE(atoms.forces.isApprox(-k_fast * atoms.positions));
+    EXPECT_NEAR(energy(), energy_before, 1e-2 * energy_before);
+
+    // without slow forces a step is the same as plain velocity verlet steps
+    Atoms reference{atoms};
+    slow.setZero();
+    auto no_slow_forces = [&]() { atoms.forces.setZero(); };
+    respa_step(atoms, slow, timestep, nb_inner, fast_forces, no_slow_forces);
+    for (size_t i = 0; i < nb_inner; i++) {
+        verlet_step1(reference, timestep);
+        reference.forces = -k_fast * reference.positions;
+        verlet_step2(reference, timestep);
+    }
+    EXPECT_TRUE(atoms.positions.isApprox(reference.positions));
+    EXPECT_TRUE(atoms.velocities.isApprox(reference.velocities));
+}
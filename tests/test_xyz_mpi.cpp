@@ -0,0 +1,52 @@
+#include "xyz_mpi.h"
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+
+TEST(XyzMPITest, ReadNames) {
+    std::string filename{"test_xyz_mpi_names.xyz"};
+    {
+        std::ofstream file(filename);
+        file << "5\nfive atoms\n"
+             << "Au 0 0 0\nAu 1 0 0\nAg 2 0 0\nAg 3 0 0\nAu 4 0 0\n";
+    }
+    Atoms atoms{read_xyz_all(filename, MPI_COMM_WORLD)};
+    std::remove(filename.c_str());
+
+    ASSERT_EQ(atoms.nb_atoms(), 5);
+    std::vector<std::string> names{"Au", "Au", "Ag", "Ag", "Au"};
+    for (size_t i = 0; i < names.size(); i++) {
+        EXPECT_EQ(atoms.ids(i), i);
+        EXPECT_EQ(atoms.name(i), names[i]);
+    }
+    EXPECT_EQ(atoms.names.nb_runs(), 3);
+    EXPECT_DOUBLE_EQ(atoms.positions(0, 4), 4);
+}
+
+TEST(XyzMPITest, ReadCheckpointIds) {
+    std::string filename{"test_xyz_mpi_checkpoint.xyz"};
+    Positions_t positions(3, 4);
+    positions << 0, 1, 2, 3, 0, 0, 0, 0, 0, 0, 0, 0;
+    Atoms atoms(positions);
+    atoms.ids << 2, 0, 3, 1;
+    atoms.names = NameRuns();
+    atoms.names.append(0, "Au");
+    atoms.names.append(2, "Ag");
+    atoms.velocities.row(0) = atoms.ids.cast<double>() / 4;
+    write_xyz_all(filename, atoms, atoms.nb_atoms(), MPI_COMM_WORLD);
+
+    Atoms read{read_xyz_all(filename, MPI_COMM_WORLD, true)};
+    Atoms plain{read_xyz_all(filename, MPI_COMM_WORLD)};
+    std::remove(filename.c_str());
+
+    ASSERT_EQ(read.nb_atoms(), 4);
+    for (size_t i = 0; i < 4; i++) {
+        EXPECT_EQ(read.ids(i), atoms.ids(i));
+        EXPECT_EQ(read.name(i), atoms.name(i));
+        EXPECT_DOUBLE_EQ(read.positions(0, i), i);
+        EXPECT_DOUBLE_EQ(read.velocities(0, i), atoms.ids(i) / 4.0);
+        // without velocities, the ids follow the file
+        EXPECT_EQ(plain.ids(i), i);
+    }
+    EXPECT_EQ(read.names.nb_runs(), 2);
+}